@@ -1,18 +1,30 @@
 #include "ArucoMarkers.h"
 
 #include <string>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
 #include <iostream>
 #include <filesystem>
 
 #include <opencv2/core/core.hpp>
 #include "dictionary.hpp"
 #include "aruco.hpp"
+#include <opencv2/calib3d.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
 #include <opencv2/shape/hist_cost.hpp>
 
 timur::ArucoMarkers::ArucoMarkers(const float arucoSqureDimension,
                                   const bool usePredefinedDictionary)
-    : _arucoSqureDimension(arucoSqureDimension)
+    : _arucoSqureDimension(arucoSqureDimension),
+      _detectorParameters(cv::aruco::DetectorParameters::create(
+          cv::aruco::DETECTOR_PRESET_BALANCED)),
+      _minIdentificationMargin(0),
+      _trackHistoryLength(5),
+      _maxRecoveryDistance(10.0),
+      _frameNumber(0)
 {
     if (usePredefinedDictionary)
     {
@@ -43,41 +55,580 @@ float timur::ArucoMarkers::arucoSqureDimension() const
     return _arucoSqureDimension;
 }
 
-void timur::ArucoMarkers::createArucoMarkers(const std::string& folderName, const uint& imageSize,
-                                             const uint& borderSize) const
+cv::Ptr<cv::aruco::Dictionary> timur::ArucoMarkers::markerDictionary() const
+{
+    return _markerDictionary;
+}
+
+void timur::ArucoMarkers::setDetectorPreset(const int preset)
+{
+    _detectorParameters = cv::aruco::DetectorParameters::create(preset);
+}
+
+void timur::ArucoMarkers::setMinIdentificationMargin(const int minIdentificationMargin)
+{
+    _minIdentificationMargin = minIdentificationMargin;
+}
+
+void timur::ArucoMarkers::createSyntheticFrames(const uint countOfImages,
+                                                std::vector<cv::Mat>& frames,
+                                                std::vector<std::vector<cv::Point2f>>& corners,
+                                                std::vector<int>& ids) const
+{
+    const cv::Size frameSize(1280, 720);
+    cv::RNG rng(2017);
+
+    // every image holds one marker warped with a random perspective, its corners are known
+    cv::Mat marker;
+    for (uint i = 0; i < countOfImages; ++i)
+    {
+        const int id = static_cast<int>(i) % _markerDictionary->bytesList.rows;
+        const int side = rng.uniform(40, 240);
+        cv::aruco::drawMarker(_markerDictionary, id, side, marker);
+
+        const std::vector<cv::Point2f> markerCorners{
+            {-0.5f, -0.5f}, {side - 0.5f, -0.5f}, {side - 0.5f, side - 0.5f}, {-0.5f, side - 0.5f}
+        };
+        const cv::Point2f center(rng.uniform(side, frameSize.width - side),
+                                 rng.uniform(side, frameSize.height - side));
+        std::vector<cv::Point2f> frameCorners;
+        for (const auto& corner : markerCorners)
+        {
+            const cv::Point2f jitter(rng.uniform(-0.15f, 0.15f) * side,
+                                     rng.uniform(-0.15f, 0.15f) * side);
+            frameCorners.push_back(center + corner - cv::Point2f(side / 2.f, side / 2.f) + jitter);
+        }
+
+        cv::Mat frame;
+        cv::warpPerspective(marker, frame, cv::getPerspectiveTransform(markerCorners, frameCorners),
+                            frameSize, cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar::all(255));
+        cv::GaussianBlur(frame, frame, cv::Size(3, 3), 0);
+        cv::Mat noisyFrame, noise(frameSize, CV_16S);
+        rng.fill(noise, cv::RNG::NORMAL, 0, 4);
+        frame.convertTo(noisyFrame, CV_16S);
+        noisyFrame += noise;
+        noisyFrame.convertTo(frame, CV_8U);
+
+        frames.push_back(frame);
+        corners.push_back(frameCorners);
+        ids.push_back(id);
+    }
+}
+
+double timur::ArucoMarkers::runDetectionBenchmark(
+    const std::string& name, const cv::Ptr<cv::aruco::DetectorParameters>& parameters,
+    const std::vector<cv::Mat>& frames,
+    const std::vector<std::vector<cv::Point2f>>& groundTruthCorners,
+    const std::vector<int>& groundTruthIds, uint& countOfDetected) const
 {
+    int64 ticks = 0;
+    countOfDetected = 0;
+    double squaredError = 0;
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        std::vector<std::vector<cv::Point2f>> corners;
+        std::vector<int> ids;
+        const int64 start = cv::getTickCount();
+        cv::aruco::detectMarkers(frames[i], _markerDictionary, corners, ids, parameters);
+        ticks += cv::getTickCount() - start;
+
+        for (size_t k = 0; k < ids.size(); ++k)
+        {
+            if (ids[k] != groundTruthIds[i])
+            {
+                continue;
+            }
+            ++countOfDetected;
+            for (int c = 0; c < 4; ++c)
+            {
+                const cv::Point2f error = corners[k][c] - groundTruthCorners[i][c];
+                squaredError += error.dot(error);
+            }
+            break;
+        }
+    }
+    const double msPerFrame = 1000. * ticks / cv::getTickFrequency() / frames.size();
+    std::cout << name << ": " << msPerFrame << " ms/frame, " << 1000. / msPerFrame << " fps, detected "
+              << countOfDetected << '/' << frames.size() << ", corner RMS "
+              << (countOfDetected ? std::sqrt(squaredError / (4. * countOfDetected)) : 0.) << " px"
+              << '\n';
+    return msPerFrame;
+}
+
+void timur::ArucoMarkers::benchmarkDetectorPresets(const uint countOfImages) const
+{
+    std::vector<cv::Mat> frames;
+    std::vector<std::vector<cv::Point2f>> corners;
+    std::vector<int> ids;
+    createSyntheticFrames(countOfImages, frames, corners, ids);
+
+    const std::string presetNames[] = {"fast", "balanced", "accurate"};
+    for (int preset = cv::aruco::DETECTOR_PRESET_FAST; preset <= cv::aruco::DETECTOR_PRESET_ACCURATE;
+         ++preset)
+    {
+        uint countOfDetected;
+        runDetectionBenchmark(presetNames[preset], cv::aruco::DetectorParameters::create(preset),
+                              frames, corners, ids, countOfDetected);
+    }
+}
+
+void timur::ArucoMarkers::benchmarkCornerRefinement(const uint countOfImages) const
+{
+    std::vector<cv::Mat> frames;
+    std::vector<std::vector<cv::Point2f>> corners;
+    std::vector<int> ids;
+    createSyntheticFrames(countOfImages, frames, corners, ids);
+
+    // refinement cost is the difference to the same detection without refinement
+    const std::string methodNames[] = {"none", "subpix", "contour"};
+    double msWithoutRefinement = 0;
+    uint countOfDetected;
+    for (int method = cv::aruco::CORNER_REFINE_NONE; method <= cv::aruco::CORNER_REFINE_CONTOUR;
+         ++method)
+    {
+        const cv::Ptr<cv::aruco::DetectorParameters> parameters =
+            cv::makePtr<cv::aruco::DetectorParameters>(*_detectorParameters);
+        parameters->cornerRefinementMethod = method;
+        const double msPerFrame = runDetectionBenchmark(methodNames[method], parameters, frames,
+                                                        corners, ids, countOfDetected);
+        if (method == cv::aruco::CORNER_REFINE_NONE)
+        {
+            msWithoutRefinement = msPerFrame;
+        }
+        else
+        {
+            const double msRefinement = msPerFrame - msWithoutRefinement;
+            std::cout << "  refinement: " << msRefinement << " ms/frame, "
+                      << (countOfDetected ? 1000. * msRefinement * frames.size() / countOfDetected : 0.)
+                      << " us/marker" << '\n';
+        }
+    }
+}
+
+void timur::ArucoMarkers::benchmarkIdentification(const uint countOfCodes) const
+{
+    if (countOfCodes == 0)
+    {
+        return;
+    }
+
+    const int markerSize = _markerDictionary->markerSize;
+    cv::RNG rng(2017);
+
+    // half of the codes are dictionary markers with a few flipped bits, half are random codes
+    // as most candidates of a real frame
+    std::vector<cv::Mat> codes;
+    for (uint i = 0; i < countOfCodes; ++i)
+    {
+        cv::Mat bits;
+        if (i % 2 == 0)
+        {
+            const int id = rng.uniform(0, _markerDictionary->bytesList.rows);
+            bits = cv::aruco::Dictionary::getBitsFromByteList(
+                _markerDictionary->bytesList.rowRange(id, id + 1), markerSize);
+            const int countOfFlips = rng.uniform(0, _markerDictionary->maxCorrectionBits + 2);
+            for (int flip = 0; flip < countOfFlips; ++flip)
+            {
+                uchar& bit = bits.at<uchar>(rng.uniform(0, markerSize), rng.uniform(0, markerSize));
+                bit = 1 - bit;
+            }
+        }
+        else
+        {
+            bits.create(markerSize, markerSize, CV_8UC1);
+            rng.fill(bits, cv::RNG::UNIFORM, 0, 2);
+        }
+        codes.push_back(bits);
+    }
+
+    const double correctionRates[] = {0., 0.3, 0.6};
+    for (const double correctionRate : correctionRates)
+    {
+        std::vector<int> linearIds(codes.size()), linearRotations(codes.size(), -1);
+        int64 start = cv::getTickCount();
+        for (size_t i = 0; i < codes.size(); ++i)
+        {
+            _markerDictionary->identifyLinear(codes[i], linearIds[i], linearRotations[i],
+                                              correctionRate);
+        }
+        const int64 linearTicks = cv::getTickCount() - start;
+
+        std::vector<int> prunedIds(codes.size()), prunedRotations(codes.size(), -1);
+        start = cv::getTickCount();
+        for (size_t i = 0; i < codes.size(); ++i)
+        {
+            _markerDictionary->identify(codes[i], prunedIds[i], prunedRotations[i],
+                                        correctionRate);
+        }
+        const int64 prunedTicks = cv::getTickCount() - start;
+
+        uint countOfIdentified = 0, countOfMismatches = 0;
+        for (size_t i = 0; i < codes.size(); ++i)
+        {
+            countOfIdentified += linearIds[i] >= 0 ? 1 : 0;
+            const bool sameRotation = linearIds[i] < 0 || linearRotations[i] == prunedRotations[i];
+            countOfMismatches += linearIds[i] != prunedIds[i] || !sameRotation ? 1 : 0;
+        }
+
+        const double ticksToMicroseconds = 1e6 / cv::getTickFrequency() / codes.size();
+        std::cout << "correction rate " << correctionRate << ": linear "
+                  << linearTicks * ticksToMicroseconds << " us/code, prefix pruned "
+                  << prunedTicks * ticksToMicroseconds << " us/code, identified "
+                  << countOfIdentified << '/' << codes.size() << ", mismatches "
+                  << countOfMismatches << '\n';
+    }
+}
+
+void timur::ArucoMarkers::compareCandidateEngines(const std::string& videoFileName) const
+{
+    cv::VideoCapture video(videoFileName);
+    if (!video.isOpened())
+    {
+        std::cout << "Can not open video! Wrong name!" << '\n';
+        return;
+    }
+
+    const std::string engineNames[] = {"contours", "line segments"};
+    cv::Ptr<cv::aruco::DetectorParameters> parameters[] = {
+        cv::makePtr<cv::aruco::DetectorParameters>(*_detectorParameters),
+        cv::makePtr<cv::aruco::DetectorParameters>(*_detectorParameters)
+    };
+    parameters[0]->candidateEngine = cv::aruco::CANDIDATE_ENGINE_CONTOURS;
+    parameters[1]->candidateEngine = cv::aruco::CANDIDATE_ENGINE_LINE_SEGMENTS;
+
+    int64 ticks[2] = {0, 0};
+    uint countOfMarkers[2] = {0, 0};
+    uint countOfFramesWithMarkers[2] = {0, 0};
+    uint countOfFrames = 0;
+    cv::Mat frame, frameGray;
+    while (video.read(frame))
+    {
+        ++countOfFrames;
+        cv::cvtColor(frame, frameGray, CV_BGR2GRAY);
+        for (int engine = 0; engine < 2; ++engine)
+        {
+            std::vector<std::vector<cv::Point2f>> corners;
+            std::vector<int> ids;
+            const int64 start = cv::getTickCount();
+            cv::aruco::detectMarkers(frameGray, _markerDictionary, corners, ids, parameters[engine]);
+            ticks[engine] += cv::getTickCount() - start;
+            countOfMarkers[engine] += static_cast<uint>(ids.size());
+            countOfFramesWithMarkers[engine] += ids.empty() ? 0 : 1;
+        }
+    }
+
+    for (int engine = 0; engine < 2 && countOfFrames > 0; ++engine)
+    {
+        std::cout << engineNames[engine] << ": "
+                  << 1000. * ticks[engine] / cv::getTickFrequency() / countOfFrames
+                  << " ms/frame, " << countOfMarkers[engine] << " markers, "
+                  << countOfFramesWithMarkers[engine] << '/' << countOfFrames
+                  << " frames with markers" << '\n';
+    }
+}
+
+void timur::ArucoMarkers::saveImagesInParallel(
+    const std::string& folderName, const std::string& fileNamePrefix, const int countOfImages,
+    const std::string& imageFormat, const uint maxImagesInFlight,
+    const std::function<void(int, cv::Mat&)>& renderImage) const
+{
+    CV_Assert(maxImagesInFlight > 0);
     std::experimental::filesystem::create_directory(folderName);
+    const std::string extension = '.' + imageFormat;
 
-    cv::Mat outputMarker;
-    for (int i = 0; i < _markerDictionary->bytesList.rows; ++i)
+    // images are rendered and encoded in parallel by batches, every batch is written to the disk
+    // before the next one starts, so memory is bounded by maxImagesInFlight encoded images
+    std::vector<std::vector<uchar>> encodedImages(std::min<size_t>(maxImagesInFlight,
+                                                                   countOfImages));
+    std::vector<char> encoded(encodedImages.size());
+    for (int first = 0; first < countOfImages; first += static_cast<int>(encodedImages.size()))
     {
-        cv::aruco::drawMarker(_markerDictionary, i, imageSize, outputMarker, borderSize);
-        std::stringstream convert;
-        convert << folderName << '/' << i << ".png";
-        cv::imwrite(convert.str(), outputMarker);
+        const int last = std::min(countOfImages, first + static_cast<int>(encodedImages.size()));
+        cv::parallel_for_(cv::Range(first, last), [&](const cv::Range& range)
+        {
+            cv::Mat image;
+            for (int i = range.start; i < range.end; ++i)
+            {
+                renderImage(i, image);
+                encoded[i - first] = cv::imencode(extension, image, encodedImages[i - first]);
+            }
+        });
+
+        for (int i = first; i < last; ++i)
+        {
+            const std::string fileName = folderName + '/' + fileNamePrefix + std::to_string(i)
+                                         + extension;
+            std::ofstream outStream(fileName, std::ios::binary);
+            if (!encoded[i - first] || !outStream.write(
+                    reinterpret_cast<const char*>(encodedImages[i - first].data()),
+                    encodedImages[i - first].size()))
+            {
+                std::cout << "Can not save " << fileName << '\n';
+            }
+        }
     }
 }
 
-bool timur::ArucoMarkers::estimateMarkersPose(const cv::Mat frame, const cv::Mat cameraMatrix,
-                                              const cv::Mat distanceCoefficients,
-                                              std::vector<cv::Vec3d>& rotationVectors,
-                                              std::vector<cv::Vec3d>& translationVectors,
-                                              std::vector<int>& markerIds) const
+void timur::ArucoMarkers::createArucoMarkers(const std::string& folderName, const uint& imageSize,
+                                             const uint& borderSize,
+                                             const std::string& imageFormat,
+                                             const uint maxImagesInFlight) const
+{
+    saveImagesInParallel(folderName, "", _markerDictionary->bytesList.rows, imageFormat,
+                         maxImagesInFlight, [&](const int id, cv::Mat& outputMarker)
+    {
+        cv::aruco::drawMarker(_markerDictionary, id, imageSize, outputMarker, borderSize);
+    });
+}
+
+void timur::ArucoMarkers::createArucoMarkerSheets(const std::string& folderName,
+                                                  const cv::Size& markersPerSheet,
+                                                  const cv::Size& sheetSize,
+                                                  const uint& marginSize,
+                                                  const float markerSeparationRate,
+                                                  const uint& borderSize,
+                                                  const std::string& imageFormat,
+                                                  const uint maxImagesInFlight) const
+{
+    CV_Assert(markersPerSheet.area() > 0 && markerSeparationRate > 0);
+    const int countOfMarkers = _markerDictionary->bytesList.rows;
+    const int markersOnSheet = markersPerSheet.area();
+    const int countOfSheets = (countOfMarkers + markersOnSheet - 1) / markersOnSheet;
+    const int margin = static_cast<int>(marginSize);
+    const cv::Size innerSize(sheetSize.width - 2 * margin, sheetSize.height - 2 * margin);
+    CV_Assert(innerSize.area() > 0);
+
+    saveImagesInParallel(folderName, "sheet_", countOfSheets, imageFormat, maxImagesInFlight,
+                         [&](const int sheet, cv::Mat& sheetImage)
+    {
+        const int firstMarker = sheet * markersOnSheet;
+        const int countOnSheet = std::min(markersOnSheet, countOfMarkers - firstMarker);
+        const cv::Ptr<cv::aruco::GridBoard> board = cv::aruco::GridBoard::create(
+            markersPerSheet.width, markersPerSheet.height, 1.f, markerSeparationRate,
+            _markerDictionary, firstMarker);
+        board->ids.resize(countOnSheet);
+        board->objPoints.resize(countOnSheet);
+
+        // the last sheet may be incomplete, it is drawn in a proportionally smaller area of the
+        // sheet so that its markers have the same size as on the other sheets
+        const int usedColumns = std::min(countOnSheet, markersPerSheet.width);
+        const int usedRows = (countOnSheet + markersPerSheet.width - 1) / markersPerSheet.width;
+        const auto boardLength = [&](const int count)
+        {
+            return count + (count - 1) * markerSeparationRate;
+        };
+        const cv::Size boardSize(
+            cvRound(innerSize.width * boardLength(usedColumns) / boardLength(markersPerSheet.width))
+            + 2 * margin,
+            cvRound(innerSize.height * boardLength(usedRows) / boardLength(markersPerSheet.height))
+            + 2 * margin);
+
+        sheetImage.create(sheetSize, CV_8UC1);
+        sheetImage.setTo(cv::Scalar::all(255));
+        cv::Mat boardImage = sheetImage(cv::Rect(cv::Point(0, 0), boardSize));
+        cv::aruco::drawPlanarBoard(board, boardSize, boardImage, margin, borderSize);
+    });
+}
+
+void timur::ArucoMarkers::detectMarkersOnValue(const cv::Mat frame, const cv::Mat cameraMatrix,
+                                               const cv::Mat distanceCoefficients,
+                                               std::vector<std::vector<cv::Point2f>>& markerCorners,
+                                               std::vector<int>& markerIds,
+                                               std::vector<std::vector<cv::Point2f>>& rejectedCorners,
+                                               cv::Mat& valueChannel) const
 {
     cv::Mat frameHsv;
     std::vector<cv::Mat> hsvChannels;
     cv::cvtColor(frame, frameHsv, CV_BGR2HSV);
     cv::split(frameHsv, hsvChannels);
+    valueChannel = hsvChannels[2];
+
+    std::vector<cv::Vec3i> confidences;
+    cv::aruco::detectMarkers(valueChannel, _markerDictionary, markerCorners, markerIds,
+                             _detectorParameters, rejectedCorners, cameraMatrix,
+                             distanceCoefficients, confidences);
+
+    // drop markers whose bits are almost as close to another id
+    size_t countOfKept = 0;
+    for (size_t i = 0; i < markerIds.size(); ++i)
+    {
+        if (confidences[i][1] - confidences[i][0] >= _minIdentificationMargin)
+        {
+            markerCorners[countOfKept] = markerCorners[i];
+            markerIds[countOfKept] = markerIds[i];
+            ++countOfKept;
+        }
+    }
+    markerCorners.resize(countOfKept);
+    markerIds.resize(countOfKept);
+}
+
+void timur::ArucoMarkers::recoverMarkers(const cv::Mat valueChannel, const cv::Mat cameraMatrix,
+                                         const cv::Mat distanceCoefficients,
+                                         const std::vector<std::vector<cv::Point2f>>& rejectedCorners,
+                                         std::vector<std::vector<cv::Point2f>>& markerCorners,
+                                         std::vector<int>& markerIds)
+{
+    const float halfLength = _arucoSqureDimension / 2.f;
+    const std::vector<cv::Point3f> objectPoints = {
+        cv::Point3f(-halfLength, halfLength, 0.f), cv::Point3f(halfLength, halfLength, 0.f),
+        cv::Point3f(halfLength, -halfLength, 0.f), cv::Point3f(-halfLength, -halfLength, 0.f)
+    };
+    const int maxCorrectionBits = int(_markerDictionary->maxCorrectionBits *
+                                      _detectorParameters->errorCorrectionRate);
+    std::vector<bool> usedCandidates(rejectedCorners.size(), false);
+
+    for (auto track = _markerTracks.begin(); track != _markerTracks.end();)
+    {
+        MarkerTrack& markerTrack = track->second;
+        if (_frameNumber - markerTrack.lastSeenFrame > _trackHistoryLength)
+        {
+            track = _markerTracks.erase(track);
+            continue;
+        }
+        if (std::find(markerIds.begin(), markerIds.end(), track->first) != markerIds.end())
+        {
+            // detected as usual, bits of the lost frames are not needed anymore
+            markerTrack.recentBits.clear();
+            ++track;
+            continue;
+        }
+
+        std::vector<cv::Point2f> projectedCorners;
+        cv::projectPoints(objectPoints, markerTrack.rotationVector, markerTrack.translationVector,
+                          cameraMatrix, distanceCoefficients, projectedCorners);
+
+        // the closest free candidate over its four rotations
+        int bestCandidate = -1;
+        int bestRotation = 0;
+        double bestDistance = _maxRecoveryDistance;
+        for (size_t j = 0; j < rejectedCorners.size(); ++j)
+        {
+            if (usedCandidates[j])
+            {
+                continue;
+            }
+            for (int rotation = 0; rotation < 4; ++rotation)
+            {
+                double distance = 0.0;
+                for (int c = 0; c < 4; ++c)
+                {
+                    distance += cv::norm(projectedCorners[c] -
+                                         rejectedCorners[j][(c + rotation) % 4]);
+                }
+                distance /= 4.0;
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    bestCandidate = int(j);
+                    bestRotation = rotation;
+                }
+            }
+        }
+        if (bestCandidate < 0)
+        {
+            ++track;
+            continue;
+        }
+
+        std::vector<cv::Point2f> candidateCorners(4);
+        for (int c = 0; c < 4; ++c)
+        {
+            candidateCorners[c] = rejectedCorners[bestCandidate][(c + bestRotation) % 4];
+        }
+
+        cv::Mat bits;
+        cv::aruco::extractMarkerBits(valueChannel, candidateCorners, _markerDictionary, bits,
+                                     _detectorParameters);
+        markerTrack.recentBits.push_back(bits);
+        if (markerTrack.recentBits.size() > _trackHistoryLength)
+        {
+            markerTrack.recentBits.pop_front();
+        }
+
+        // majority vote of the bits over the lost frames, ties are taken from the current frame
+        cv::Mat votes = cv::Mat::zeros(bits.size(), CV_32S);
+        for (const auto& recentBits : markerTrack.recentBits)
+        {
+            cv::add(votes, recentBits, votes, cv::noArray(), CV_32S);
+        }
+        const int countOfVotes = int(markerTrack.recentBits.size());
+        cv::Mat votedBits = bits.clone();
+        for (int y = 0; y < votedBits.rows; ++y)
+        {
+            for (int x = 0; x < votedBits.cols; ++x)
+            {
+                const int doubledVotes = 2 * votes.at<int>(y, x);
+                if (doubledVotes != countOfVotes)
+                {
+                    votedBits.at<uchar>(y, x) = doubledVotes > countOfVotes ? 1 : 0;
+                }
+            }
+        }
+
+        if (_markerDictionary->getDistanceToId(votedBits, track->first, false) <= maxCorrectionBits)
+        {
+            usedCandidates[bestCandidate] = true;
+            markerCorners.push_back(candidateCorners);
+            markerIds.push_back(track->first);
+        }
+        ++track;
+    }
+}
+
+bool timur::ArucoMarkers::detectMarkers(const cv::Mat frame, const cv::Mat cameraMatrix,
+                                        const cv::Mat distanceCoefficients,
+                                        std::vector<std::vector<cv::Point2f>>& markerCorners,
+                                        std::vector<int>& markerIds) const
+{
+    std::vector<std::vector<cv::Point2f>> rejectedCorners;
+    cv::Mat valueChannel;
+    detectMarkersOnValue(frame, cameraMatrix, distanceCoefficients, markerCorners, markerIds,
+                         rejectedCorners, valueChannel);
+    return !markerCorners.empty();
+}
+
+bool timur::ArucoMarkers::estimateMarkersPose(const cv::Mat frame, const cv::Mat cameraMatrix,
+                                              const cv::Mat distanceCoefficients,
+                                              std::vector<cv::Vec3d>& rotationVectors,
+                                              std::vector<cv::Vec3d>& translationVectors,
+                                              std::vector<int>& markerIds,
+                                              std::vector<std::vector<cv::Point2f>>& markerCorners)
+{
+    ++_frameNumber;
+
+    std::vector<std::vector<cv::Point2f>> rejectedCorners;
+    cv::Mat valueChannel;
+    detectMarkersOnValue(frame, cameraMatrix, distanceCoefficients, markerCorners, markerIds,
+                         rejectedCorners, valueChannel);
+    recoverMarkers(valueChannel, cameraMatrix, distanceCoefficients, rejectedCorners,
+                   markerCorners, markerIds);
 
-    std::vector<std::vector<cv::Point2f>> markerCorners;
-    cv::aruco::detectMarkers(hsvChannels[2], _markerDictionary, markerCorners, markerIds);
     if (!markerCorners.empty())
     {
         cv::aruco::estimatePoseSingleMarkers(markerCorners, _arucoSqureDimension, cameraMatrix,
                                              distanceCoefficients, rotationVectors,
                                              translationVectors);
+        for (size_t i = 0; i < markerIds.size(); ++i)
+        {
+            MarkerTrack& markerTrack = _markerTracks[markerIds[i]];
+            markerTrack.rotationVector = rotationVectors[i];
+            markerTrack.translationVector = translationVectors[i];
+            markerTrack.lastSeenFrame = _frameNumber;
+        }
         cv::aruco::drawDetectedMarkers(frame, markerCorners);
         return true;
     }
     return false;
 }
+
+bool timur::ArucoMarkers::estimateMarkersPose(const cv::Mat frame, const cv::Mat cameraMatrix,
+                                              const cv::Mat distanceCoefficients,
+                                              std::vector<cv::Vec3d>& rotationVectors,
+                                              std::vector<cv::Vec3d>& translationVectors,
+                                              std::vector<int>& markerIds)
+{
+    std::vector<std::vector<cv::Point2f>> markerCorners;
+    return estimateMarkersPose(frame, cameraMatrix, distanceCoefficients, rotationVectors,
+                               translationVectors, markerIds, markerCorners);
+}
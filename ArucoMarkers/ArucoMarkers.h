@@ -5,9 +5,13 @@
 #ifndef ARUCO_DETECTION_MARKERS_2017
 #define ARUCO_DETECTION_MARKERS_2017
 
+#include <deque>
+#include <functional>
+#include <map>
 #include <string>
 
 #include <dictionary.hpp>
+#include <aruco.hpp>
 
 namespace timur
 {
@@ -17,6 +21,17 @@ namespace timur
 class ArucoMarkers
 {
 private:
+    /**
+     * \brief Last pose of a marker and bits of rejected candidates matched to it since then.
+     */
+    struct MarkerTrack
+    {
+        cv::Vec3d rotationVector;
+        cv::Vec3d translationVector;
+        uint lastSeenFrame;
+        std::deque<cv::Mat> recentBits;
+    };
+
     /**
      * \brief The length of the aruco marker's side.
      */
@@ -27,6 +42,116 @@ private:
      */
     cv::Ptr<cv::aruco::Dictionary> _markerDictionary;
 
+    /**
+     * \brief Parameters of marker detection, filled from one of cv::aruco::DetectorPreset.
+     */
+    cv::Ptr<cv::aruco::DetectorParameters> _detectorParameters;
+
+    /**
+     * \brief Minimum difference between the Hamming distances of a detected marker to the
+     * closest other id and to its own id. Ambiguous markers below it are dropped (0 keeps all).
+     */
+    int _minIdentificationMargin;
+
+    /**
+     * \brief Count of frames a lost marker is tracked and of candidate bits kept for it.
+     */
+    const uint _trackHistoryLength;
+
+    /**
+     * \brief Maximum mean distance in pixels between the projected corners of a lost marker and
+     * the corners of a rejected candidate.
+     */
+    const double _maxRecoveryDistance;
+
+    /**
+     * \brief Number of the current frame of estimateMarkersPose.
+     */
+    uint _frameNumber;
+
+    /**
+     * \brief Recently seen markers by identifier.
+     */
+    std::map<int, MarkerTrack> _markerTracks;
+
+    /**
+     * \brief Detecting markers on the value channel of the frame.
+     * \param[in] frame Frame for detecting markers.
+     * \param[in] cameraMatrix Intrinsic parameters of the camera.
+     * \param[in] distanceCoefficients Distortion coefficients.
+     * \param[out] markerCorners Array of corners of the detected markers.
+     * \param[out] markerIds Array of identifiers of the detected markers.
+     * \param[out] rejectedCorners Array of corners of the rejected candidates.
+     * \param[out] valueChannel Value channel of the frame used for detection.
+     */
+    void detectMarkersOnValue(const cv::Mat frame, const cv::Mat cameraMatrix,
+                              const cv::Mat distanceCoefficients,
+                              std::vector<std::vector<cv::Point2f>>& markerCorners,
+                              std::vector<int>& markerIds,
+                              std::vector<std::vector<cv::Point2f>>& rejectedCorners,
+                              cv::Mat& valueChannel) const;
+
+    /**
+     * \brief Recovering recently seen markers missing on the frame from the rejected candidates.
+     * The lost marker is projected with its last pose, the closest candidate is sampled and its
+     * bits are voted with the bits of previous frames before matching them with the marker code.
+     * \param[in] valueChannel Value channel of the frame used for detection.
+     * \param[in] cameraMatrix Intrinsic parameters of the camera.
+     * \param[in] distanceCoefficients Distortion coefficients.
+     * \param[in] rejectedCorners Array of corners of the rejected candidates.
+     * \param[in, out] markerCorners Array of corners of the detected markers.
+     * \param[in, out] markerIds Array of identifiers of the detected markers.
+     */
+    void recoverMarkers(const cv::Mat valueChannel, const cv::Mat cameraMatrix,
+                        const cv::Mat distanceCoefficients,
+                        const std::vector<std::vector<cv::Point2f>>& rejectedCorners,
+                        std::vector<std::vector<cv::Point2f>>& markerCorners,
+                        std::vector<int>& markerIds);
+
+    /**
+     * \brief Rendering frames with one dictionary marker in a random perspective on each of them.
+     * \param[in] countOfImages Count of generated frames.
+     * \param[out] frames Generated greyscale frames.
+     * \param[out] corners Real corners of the marker on each frame.
+     * \param[out] ids Identifier of the marker on each frame.
+     */
+    void createSyntheticFrames(const uint countOfImages, std::vector<cv::Mat>& frames,
+                               std::vector<std::vector<cv::Point2f>>& corners,
+                               std::vector<int>& ids) const;
+
+    /**
+     * \brief Detecting markers on synthetic frames and printing speed, detection rate and corner
+     * RMS error.
+     * \param[in] name Name of the benchmark case.
+     * \param[in] parameters Detector parameters of the case.
+     * \param[in] frames Frames from createSyntheticFrames.
+     * \param[in] groundTruthCorners Real corners of the marker on each frame.
+     * \param[in] groundTruthIds Identifier of the marker on each frame.
+     * \param[out] countOfDetected Count of frames where the marker was found.
+     * \return Detection time per frame in milliseconds.
+     */
+    double runDetectionBenchmark(const std::string& name,
+                                 const cv::Ptr<cv::aruco::DetectorParameters>& parameters,
+                                 const std::vector<cv::Mat>& frames,
+                                 const std::vector<std::vector<cv::Point2f>>& groundTruthCorners,
+                                 const std::vector<int>& groundTruthIds,
+                                 uint& countOfDetected) const;
+
+    /**
+     * \brief Rendering and encoding images in parallel and saving them as prefix + index.
+     * At most maxImagesInFlight encoded images are kept before they are written to the disk.
+     * \param[in] folderName Folder name for saving images.
+     * \param[in] fileNamePrefix Prefix of the file names.
+     * \param[in] countOfImages Count of images.
+     * \param[in] imageFormat Extension of the output images.
+     * \param[in] maxImagesInFlight Maximum count of encoded images kept in memory.
+     * \param[in] renderImage Function drawing image with certain index.
+     */
+    void saveImagesInParallel(const std::string& folderName, const std::string& fileNamePrefix,
+                              const int countOfImages, const std::string& imageFormat,
+                              const uint maxImagesInFlight,
+                              const std::function<void(int, cv::Mat&)>& renderImage) const;
+
 public:
 
     /**
@@ -48,14 +173,121 @@ public:
      */
     float arucoSqureDimension() const;
 
+    /**
+     * \brief Returning property of _markerDictionary.
+     * \return Value of the private field _markerDictionary.
+     */
+    cv::Ptr<cv::aruco::Dictionary> markerDictionary() const;
+
+    /**
+     * \brief Switching detector to another preset, takes effect from the next frame.
+     * \param[in] preset One of cv::aruco::DetectorPreset (fast = 0, balanced = 1, accurate = 2).
+     */
+    void setDetectorPreset(const int preset);
+
+    /**
+     * \brief Setting minimum identification margin of detected markers, see
+     * _minIdentificationMargin.
+     * \param[in] minIdentificationMargin Margin in bits, 0 keeps all detected markers.
+     */
+    void setMinIdentificationMargin(const int minIdentificationMargin);
+
+    /**
+     * \brief Measuring speed and corner accuracy of every detector preset on synthetic images
+     * with known marker corners and printing the results.
+     * \param[in] countOfImages Count of generated images.
+     */
+    void benchmarkDetectorPresets(const uint countOfImages = 200) const;
+
+    /**
+     * \brief Comparing corner refinement methods (none, subpix, contour) with the current
+     * detector parameters on synthetic images and printing their time per frame and per marker
+     * and their corner accuracy.
+     * \param[in] countOfImages Count of generated images.
+     */
+    void benchmarkCornerRefinement(const uint countOfImages = 200) const;
+
+    /**
+     * \brief Comparing prefix-pruned and linear marker identification on noisy dictionary codes
+     * and random codes for correction rates 0, 0.3 and 0.6 and printing their time.
+     * \param[in] countOfCodes Count of generated codes.
+     */
+    void benchmarkIdentification(const uint countOfCodes = 20000) const;
+
+    /**
+     * \brief Running both candidate engines (contours and line segments) with the current
+     * detector parameters on every frame of a video and printing their time and detections.
+     * \param[in] videoFileName Name of the video file.
+     */
+    void compareCandidateEngines(const std::string& videoFileName) const;
+
     /**
      * \brief Creating aruco markers images from dictionary and saving them.
+     * Images are rendered and encoded in parallel.
      * \param[in] folderName Folder name for saving markers images.
      * \param[in] imageSize Length of the image side in pixels.
-     * \param[in] borderSize Width of the marker border in pixels.
+     * \param[in] borderSize Width of the marker border in bits.
+     * \param[in] imageFormat Extension of the output images (png, jpg, bmp, tiff, ...).
+     * \param[in] maxImagesInFlight Maximum count of encoded images kept in memory before saving.
      */
     void createArucoMarkers(const std::string& folderName, const uint& imageSize = 500,
-                            const uint& borderSize = 1) const;
+                            const uint& borderSize = 1, const std::string& imageFormat = "png",
+                            const uint maxImagesInFlight = 64) const;
+
+    /**
+     * \brief Creating print-ready sheets with a grid of dictionary markers and saving them.
+     * Sheets are rendered and encoded in parallel.
+     * \param[in] folderName Folder name for saving sheets images.
+     * \param[in] markersPerSheet Count of markers by width and height of a sheet.
+     * \param[in] sheetSize Size of a sheet in pixels (default is A4 at 300 dpi).
+     * \param[in] marginSize Width of the white sheet margins in pixels.
+     * \param[in] markerSeparationRate Distance between markers relative to the marker side.
+     * \param[in] borderSize Width of the marker border in bits.
+     * \param[in] imageFormat Extension of the output images (png, jpg, bmp, tiff, ...).
+     * \param[in] maxImagesInFlight Maximum count of encoded sheets kept in memory before saving.
+     */
+    void createArucoMarkerSheets(const std::string& folderName,
+                                 const cv::Size& markersPerSheet = cv::Size(4, 6),
+                                 const cv::Size& sheetSize = cv::Size(2480, 3508),
+                                 const uint& marginSize = 118,
+                                 const float markerSeparationRate = 0.25f,
+                                 const uint& borderSize = 1,
+                                 const std::string& imageFormat = "png",
+                                 const uint maxImagesInFlight = 8) const;
+
+    /**
+     * \brief Detecting markers on frame.
+     * \param[in] frame Frame for detecting markers.
+     * \param[in] cameraMatrix Intrinsic parameters of the camera.
+     * \param[in] distanceCoefficients Distortion coefficients.
+     * \param[out] markerCorners Array of corners of the detected markers.
+     * \param[out] markerIds Array of identifiers of the detected markers.
+     * \return True, if the markers are on the frame, and false, if not.
+     */
+    bool detectMarkers(const cv::Mat frame, const cv::Mat cameraMatrix,
+                       const cv::Mat distanceCoefficients,
+                       std::vector<std::vector<cv::Point2f>>& markerCorners,
+                       std::vector<int>& markerIds) const;
+
+    /**
+     * \brief Estimate markers positions on frame and draw them.
+     * Markers seen on recent frames and briefly blurred or occluded on this one are recovered
+     * from the rejected candidates (see recoverMarkers), so frames should come in order.
+     * \param[in] frame Frame for calculating markers positions.
+     * \param[in] cameraMatrix Intrinsic parameters of the camera.
+     * \param[in] distanceCoefficients Distortion coefficients.
+     * \param[out] rotationVectors Array of output rotation vectors.
+     * \param[out] translationVectors Array of output translation vectors.
+     * \param[out] markerIds Array of identifiers of the detected markers.
+     * \param[out] markerCorners Array of corners of the detected markers.
+     * \return True, if the markers are on the frame, and false, if not.
+     */
+    bool estimateMarkersPose(const cv::Mat frame, const cv::Mat cameraMatrix,
+                                                  const cv::Mat distanceCoefficients,
+                                                  std::vector<cv::Vec3d>& rotationVectors,
+                                                  std::vector<cv::Vec3d>& translationVectors,
+                                                  std::vector<int>& markerIds,
+                                                  std::vector<std::vector<cv::Point2f>>& markerCorners);
 
     /**
      * \brief Estimate markers positions on frame and draw them.
@@ -71,7 +303,7 @@ public:
                                                   const cv::Mat distanceCoefficients,
                                                   std::vector<cv::Vec3d>& rotationVectors,
                                                   std::vector<cv::Vec3d>& translationVectors,
-                                                  std::vector<int>& markerIds) const;
+                                                  std::vector<int>& markerIds);
 };
 }
 
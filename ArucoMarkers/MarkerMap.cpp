@@ -0,0 +1,387 @@
+#include "MarkerMap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+#include <opencv2/calib3d.hpp>
+
+namespace
+{
+/**
+ * \brief First bytes of a marker map file.
+ */
+const char markerMapSignature[4] = {'A', 'M', 'A', 'P'};
+
+/**
+ * \brief Version of the marker map file format.
+ */
+const std::uint32_t markerMapVersion = 1;
+
+/**
+ * \brief Skew-symmetric matrix of the vector, v x w = skew(v) * w.
+ */
+cv::Matx33d skew(const cv::Vec3d& v)
+{
+    return cv::Matx33d(0, -v[2], v[1],
+                       v[2], 0, -v[0],
+                       -v[1], v[0], 0);
+}
+}
+
+timur::MarkerMap::MarkerMap(const float markerLength,
+                            const cv::Ptr<cv::aruco::Dictionary> markerDictionary,
+                            const cv::Mat cameraMatrix, const cv::Mat distortionCoefficients,
+                            const uint maxObservations)
+    : _markerLength(markerLength),
+      _maxObservations(maxObservations),
+      _markerDictionary(markerDictionary),
+      _cameraMatrix(cameraMatrix),
+      _distortionCoefficients(distortionCoefficients),
+      _hasLastPose(false)
+{
+    CV_Assert(markerLength > 0 && maxObservations > 0);
+}
+
+size_t timur::MarkerMap::size() const
+{
+    return _markers.size();
+}
+
+std::array<cv::Point3d, 4> timur::MarkerMap::markerObjectPoints() const
+{
+    // same corner order as cv::aruco::estimatePoseSingleMarkers
+    const double halfLength = _markerLength / 2.;
+    return std::array<cv::Point3d, 4>{
+        cv::Point3d(-halfLength, halfLength, 0), cv::Point3d(halfLength, halfLength, 0),
+        cv::Point3d(halfLength, -halfLength, 0), cv::Point3d(-halfLength, -halfLength, 0)
+    };
+}
+
+double timur::MarkerMap::reprojectionError(const MapMarker& marker, const cv::Matx33d& rotation,
+                                           const cv::Vec3d& translation) const
+{
+    const std::array<cv::Point3d, 4> objectPoints = markerObjectPoints();
+    std::vector<cv::Point3d> worldPoints(4);
+    for (int c = 0; c < 4; ++c)
+    {
+        worldPoints[c] = cv::Point3d(rotation * cv::Vec3d(objectPoints[c]) + translation);
+    }
+
+    double error = 0;
+    std::vector<cv::Point2d> projectedPoints;
+    for (const auto& observation : marker.observations)
+    {
+        cv::projectPoints(worldPoints, observation.rotationVector, observation.translation,
+                          _cameraMatrix, _distortionCoefficients, projectedPoints);
+        for (int c = 0; c < 4; ++c)
+        {
+            const cv::Point2d difference = cv::Point2d(observation.corners[c]) - projectedPoints[c];
+            error += difference.dot(difference);
+        }
+    }
+    return error;
+}
+
+double timur::MarkerMap::refineMarker(MapMarker& marker, const int maxIterations) const
+{
+    if (marker.observations.empty())
+    {
+        return 0;
+    }
+
+    const std::array<cv::Point3d, 4> objectPoints = markerObjectPoints();
+    std::vector<cv::Point3d> worldPoints(4);
+    std::vector<cv::Point2d> projectedPoints;
+    cv::Mat jacobian;
+
+    double error = reprojectionError(marker, marker.rotation, marker.translation);
+    double lambda = 1e-3;
+    for (int iteration = 0; iteration < maxIterations; ++iteration)
+    {
+        // marker pose is updated as R = exp(w) * R, t = t + dt, so the corner X = R * Xm + t
+        // moves by -skew(R * Xm) * w + dt
+        std::array<cv::Vec3d, 4> rotatedPoints;
+        for (int c = 0; c < 4; ++c)
+        {
+            rotatedPoints[c] = marker.rotation * cv::Vec3d(objectPoints[c]);
+            worldPoints[c] = cv::Point3d(rotatedPoints[c] + marker.translation);
+        }
+
+        cv::Matx66d normalMatrix = cv::Matx66d::zeros();
+        cv::Vec6d gradient;
+        for (const auto& observation : marker.observations)
+        {
+            cv::projectPoints(worldPoints, observation.rotationVector, observation.translation,
+                              _cameraMatrix, _distortionCoefficients, projectedPoints, jacobian);
+            for (int c = 0; c < 4; ++c)
+            {
+                // derivatives of the projection by the point in the camera frame are the
+                // derivatives by the translation vector (columns 3..5)
+                const cv::Matx23d byCameraPoint(
+                    jacobian.at<double>(2 * c, 3), jacobian.at<double>(2 * c, 4),
+                    jacobian.at<double>(2 * c, 5), jacobian.at<double>(2 * c + 1, 3),
+                    jacobian.at<double>(2 * c + 1, 4), jacobian.at<double>(2 * c + 1, 5));
+                const cv::Matx23d byWorldPoint = byCameraPoint * observation.rotation;
+                const cv::Matx23d byRotation = byWorldPoint * (-skew(rotatedPoints[c]));
+
+                cv::Matx<double, 2, 6> cornerJacobian;
+                for (int row = 0; row < 2; ++row)
+                {
+                    for (int col = 0; col < 3; ++col)
+                    {
+                        cornerJacobian(row, col) = byRotation(row, col);
+                        cornerJacobian(row, col + 3) = byWorldPoint(row, col);
+                    }
+                }
+                const cv::Vec2d residual(observation.corners[c].x - projectedPoints[c].x,
+                                         observation.corners[c].y - projectedPoints[c].y);
+                normalMatrix += cornerJacobian.t() * cornerJacobian;
+                gradient += cornerJacobian.t() * residual;
+            }
+        }
+
+        // try damped steps until the error decreases
+        bool improved = false;
+        while (!improved && lambda < 1e6)
+        {
+            cv::Matx66d dampedMatrix = normalMatrix;
+            for (int i = 0; i < 6; ++i)
+            {
+                dampedMatrix(i, i) *= 1. + lambda;
+            }
+            cv::Vec6d step;
+            if (!cv::solve(dampedMatrix, gradient, step, cv::DECOMP_CHOLESKY))
+            {
+                lambda *= 10;
+                continue;
+            }
+
+            cv::Matx33d stepRotation;
+            cv::Rodrigues(cv::Vec3d(step[0], step[1], step[2]), stepRotation);
+            const cv::Matx33d rotation = stepRotation * marker.rotation;
+            const cv::Vec3d translation = marker.translation + cv::Vec3d(step[3], step[4], step[5]);
+            const double newError = reprojectionError(marker, rotation, translation);
+            if (newError < error)
+            {
+                improved = true;
+                lambda = std::max(lambda / 10, 1e-7);
+                marker.rotation = rotation;
+                marker.translation = translation;
+                // converged when the error does not change noticeably
+                const bool converged = error - newError < 1e-8 * error;
+                error = newError;
+                if (converged)
+                {
+                    iteration = maxIterations;
+                }
+            }
+            else
+            {
+                lambda *= 10;
+            }
+        }
+        if (!improved)
+        {
+            break;
+        }
+    }
+    return std::sqrt(error / (4. * marker.observations.size()));
+}
+
+void timur::MarkerMap::updateBoard()
+{
+    const std::array<cv::Point3d, 4> objectPoints = markerObjectPoints();
+    std::vector<std::vector<cv::Point3f>> boardPoints;
+    std::vector<int> boardIds;
+    for (const auto& idAndMarker : _markers)
+    {
+        const MapMarker& marker = idAndMarker.second;
+        std::vector<cv::Point3f> corners;
+        for (const auto& objectPoint : objectPoints)
+        {
+            corners.push_back(cv::Point3f(cv::Point3d(marker.rotation * cv::Vec3d(objectPoint)
+                                                      + marker.translation)));
+        }
+        boardPoints.push_back(corners);
+        boardIds.push_back(idAndMarker.first);
+    }
+    _board = boardIds.empty()
+                 ? cv::Ptr<cv::aruco::Board>()
+                 : cv::aruco::Board::create(boardPoints, _markerDictionary, boardIds);
+}
+
+void timur::MarkerMap::addFrame(const cv::Mat cameraToWorld,
+                                const std::vector<std::vector<cv::Point2f>>& markerCorners,
+                                const std::vector<int>& markerIds)
+{
+    CV_Assert(cameraToWorld.rows == 4 && cameraToWorld.cols == 4);
+    CV_Assert(markerCorners.size() == markerIds.size());
+    if (markerIds.empty())
+    {
+        return;
+    }
+
+    cv::Matx44d cameraToWorldMatx;
+    cameraToWorld.convertTo(cameraToWorldMatx, CV_64F);
+    const cv::Matx44d worldToCamera = cameraToWorldMatx.inv();
+
+    MarkerObservation observation;
+    observation.rotation = worldToCamera.get_minor<3, 3>(0, 0);
+    cv::Rodrigues(observation.rotation, observation.rotationVector);
+    observation.translation = cv::Vec3d(worldToCamera(0, 3), worldToCamera(1, 3),
+                                        worldToCamera(2, 3));
+
+    const std::array<cv::Point3d, 4> objectPoints = markerObjectPoints();
+    const std::vector<cv::Point3d> objectPointsVector(objectPoints.begin(), objectPoints.end());
+    for (size_t i = 0; i < markerIds.size(); ++i)
+    {
+        std::copy(markerCorners[i].begin(), markerCorners[i].end(), observation.corners.begin());
+
+        auto found = _markers.find(markerIds[i]);
+        if (found == _markers.end())
+        {
+            // initial pose from this frame only: world <- camera <- marker
+            cv::Vec3d rotationVector, translationVector;
+            cv::solvePnP(objectPointsVector, markerCorners[i], _cameraMatrix,
+                         _distortionCoefficients, rotationVector, translationVector);
+            cv::Matx33d markerToCamera;
+            cv::Rodrigues(rotationVector, markerToCamera);
+
+            MapMarker marker;
+            const cv::Matx33d cameraRotation = cameraToWorldMatx.get_minor<3, 3>(0, 0);
+            marker.rotation = cameraRotation * markerToCamera;
+            marker.translation = cameraRotation * translationVector
+                                 + cv::Vec3d(cameraToWorldMatx(0, 3), cameraToWorldMatx(1, 3),
+                                             cameraToWorldMatx(2, 3));
+            found = _markers.emplace(markerIds[i], marker).first;
+        }
+
+        MapMarker& marker = found->second;
+        marker.observations.push_back(observation);
+        if (marker.observations.size() > _maxObservations)
+        {
+            marker.observations.pop_front();
+        }
+        // the marker was close to its optimum before this frame, few iterations are enough
+        refineMarker(marker, 5);
+    }
+    updateBoard();
+}
+
+bool timur::MarkerMap::markerPose(const int markerId, cv::Mat& markerToWorld) const
+{
+    const auto found = _markers.find(markerId);
+    if (found == _markers.end())
+    {
+        return false;
+    }
+    const MapMarker& marker = found->second;
+    markerToWorld = cv::Mat::eye(4, 4, CV_64F);
+    cv::Mat(marker.rotation).copyTo(markerToWorld(cv::Rect(0, 0, 3, 3)));
+    cv::Mat(marker.translation).copyTo(markerToWorld(cv::Rect(3, 0, 1, 3)));
+    return true;
+}
+
+int timur::MarkerMap::localizeCamera(const std::vector<std::vector<cv::Point2f>>& markerCorners,
+                                     const std::vector<int>& markerIds, cv::Mat& cameraToWorld)
+{
+    if (!_board || markerIds.empty())
+    {
+        return 0;
+    }
+
+    cv::Vec3d rotationVector = _lastRotationVector, translationVector = _lastTranslationVector;
+    const int countOfMarkers = cv::aruco::estimatePoseBoardRobust(
+        markerCorners, markerIds, _board, _cameraMatrix, _distortionCoefficients, rotationVector,
+        translationVector, _hasLastPose);
+    if (countOfMarkers == 0)
+    {
+        return 0;
+    }
+    _lastRotationVector = rotationVector;
+    _lastTranslationVector = translationVector;
+    _hasLastPose = true;
+
+    // invert world to camera transformation
+    cv::Matx33d worldToCamera;
+    cv::Rodrigues(rotationVector, worldToCamera);
+    const cv::Matx33d cameraRotation = worldToCamera.t();
+    cameraToWorld = cv::Mat::eye(4, 4, CV_64F);
+    cv::Mat(cameraRotation).copyTo(cameraToWorld(cv::Rect(0, 0, 3, 3)));
+    cv::Mat(-(cameraRotation * translationVector)).copyTo(cameraToWorld(cv::Rect(3, 0, 1, 3)));
+    return countOfMarkers;
+}
+
+bool timur::MarkerMap::saveMarkerMap(const std::string& fileName) const
+{
+    std::ofstream outStream(fileName, std::ios::binary);
+    if (!outStream)
+    {
+        return false;
+    }
+
+    // signature, version, marker length, count of markers, then id and pose of every marker
+    const std::uint32_t countOfMarkers = static_cast<std::uint32_t>(_markers.size());
+    outStream.write(markerMapSignature, sizeof(markerMapSignature));
+    outStream.write(reinterpret_cast<const char*>(&markerMapVersion), sizeof(markerMapVersion));
+    outStream.write(reinterpret_cast<const char*>(&_markerLength), sizeof(_markerLength));
+    outStream.write(reinterpret_cast<const char*>(&countOfMarkers), sizeof(countOfMarkers));
+    for (const auto& idAndMarker : _markers)
+    {
+        const std::int32_t id = idAndMarker.first;
+        cv::Vec3d rotationVector;
+        cv::Rodrigues(idAndMarker.second.rotation, rotationVector);
+        outStream.write(reinterpret_cast<const char*>(&id), sizeof(id));
+        outStream.write(reinterpret_cast<const char*>(rotationVector.val), 3 * sizeof(double));
+        outStream.write(reinterpret_cast<const char*>(idAndMarker.second.translation.val),
+                        3 * sizeof(double));
+    }
+    return static_cast<bool>(outStream);
+}
+
+bool timur::MarkerMap::loadMarkerMap(const std::string& fileName)
+{
+    std::ifstream inStream(fileName, std::ios::binary);
+    if (!inStream)
+    {
+        return false;
+    }
+
+    char signature[sizeof(markerMapSignature)];
+    std::uint32_t version, countOfMarkers;
+    float markerLength;
+    inStream.read(signature, sizeof(signature));
+    inStream.read(reinterpret_cast<char*>(&version), sizeof(version));
+    inStream.read(reinterpret_cast<char*>(&markerLength), sizeof(markerLength));
+    inStream.read(reinterpret_cast<char*>(&countOfMarkers), sizeof(countOfMarkers));
+    if (!inStream || std::memcmp(signature, markerMapSignature, sizeof(signature)) != 0
+        || version != markerMapVersion || markerLength != _markerLength)
+    {
+        return false;
+    }
+
+    std::map<int, MapMarker> markers;
+    for (std::uint32_t i = 0; i < countOfMarkers; ++i)
+    {
+        std::int32_t id;
+        cv::Vec3d rotationVector;
+        MapMarker marker;
+        inStream.read(reinterpret_cast<char*>(&id), sizeof(id));
+        inStream.read(reinterpret_cast<char*>(rotationVector.val), 3 * sizeof(double));
+        inStream.read(reinterpret_cast<char*>(marker.translation.val), 3 * sizeof(double));
+        if (!inStream)
+        {
+            return false;
+        }
+        cv::Rodrigues(rotationVector, marker.rotation);
+        markers[id] = marker;
+    }
+
+    _markers.swap(markers);
+    _hasLastPose = false;
+    updateBoard();
+    return true;
+}
@@ -0,0 +1,199 @@
+/**
+* \file
+* \brief Header file with class description of the map of markers in the robot world frame.
+*/
+#ifndef ARUCO_MARKER_MAP_2017
+#define ARUCO_MARKER_MAP_2017
+
+#include <array>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <dictionary.hpp>
+#include <aruco.hpp>
+
+namespace timur
+{
+/**
+ * \brief Map of markers poses in the world frame. Poses are learned from frames with known camera
+ * pose (e.g. robot flange pose from FanucModel) and then used to localize the camera from any
+ * visible subset of the markers.
+ */
+class MarkerMap
+{
+private:
+    /**
+     * \brief One marker detection together with the pose of the camera on that frame.
+     */
+    struct MarkerObservation
+    {
+        cv::Matx33d rotation;
+        cv::Vec3d rotationVector;
+        cv::Vec3d translation;
+        std::array<cv::Point2f, 4> corners;
+    };
+
+    /**
+     * \brief Marker pose in the world frame and its recent observations.
+     */
+    struct MapMarker
+    {
+        cv::Matx33d rotation;
+        cv::Vec3d translation;
+        std::deque<MarkerObservation> observations;
+    };
+
+    /**
+     * \brief The length of the marker's side in units of the world frame.
+     */
+    const float _markerLength;
+
+    /**
+     * \brief Count of the latest observations of each marker kept for refinement.
+     */
+    const uint _maxObservations;
+
+    /**
+     * \brief Dictionary of markers.
+     */
+    const cv::Ptr<cv::aruco::Dictionary> _markerDictionary;
+
+    /**
+     * \brief Intrinsic parameters of the camera.
+     */
+    const cv::Mat _cameraMatrix;
+
+    /**
+     * \brief Distortion coefficients.
+     */
+    const cv::Mat _distortionCoefficients;
+
+    /**
+     * \brief Markers of the map ordered by identifier.
+     */
+    std::map<int, MapMarker> _markers;
+
+    /**
+     * \brief Markers of the map as a board, rebuilt after every change of the map.
+     */
+    cv::Ptr<cv::aruco::Board> _board;
+
+    /**
+     * \brief World to camera transformation of the last localization, warm start of the next one.
+     */
+    cv::Vec3d _lastRotationVector, _lastTranslationVector;
+
+    /**
+     * \brief True if _lastRotationVector and _lastTranslationVector are valid.
+     */
+    bool _hasLastPose;
+
+    /**
+     * \brief Corners of the marker in its own frame, in the order of detected corners.
+     * \return Four corners of the marker.
+     */
+    std::array<cv::Point3d, 4> markerObjectPoints() const;
+
+    /**
+     * \brief Levenberg-Marquardt refinement of the marker pose over all its observations.
+     * The camera poses are fixed, so every marker is refined independently.
+     * \param[in, out] marker Marker with the initial pose.
+     * \param[in] maxIterations Maximum count of iterations.
+     * \return RMS reprojection error of the marker corners in pixels.
+     */
+    double refineMarker(MapMarker& marker, const int maxIterations) const;
+
+    /**
+     * \brief Calculating reprojection error of the marker with certain pose.
+     * \param[in] marker Marker with observations.
+     * \param[in] rotation Rotation of the marker in the world frame.
+     * \param[in] translation Translation of the marker in the world frame.
+     * \return Sum of squared reprojection errors of the marker corners.
+     */
+    double reprojectionError(const MapMarker& marker, const cv::Matx33d& rotation,
+                             const cv::Vec3d& translation) const;
+
+    /**
+     * \brief Rebuilding _board from the current markers poses.
+     */
+    void updateBoard();
+
+public:
+
+    /**
+     * \brief MarkerMap constructor.
+     * \param[in] markerLength The length of the marker's side in units of the world frame.
+     * \param[in] markerDictionary Dictionary of markers.
+     * \param[in] cameraMatrix Intrinsic parameters of the camera.
+     * \param[in] distortionCoefficients Distortion coefficients.
+     * \param[in] maxObservations Count of the latest observations of each marker kept for
+     * refinement.
+     */
+    MarkerMap(const float markerLength, const cv::Ptr<cv::aruco::Dictionary> markerDictionary,
+              const cv::Mat cameraMatrix, const cv::Mat distortionCoefficients,
+              const uint maxObservations = 300);
+
+    /**
+     * \brief MarkerMap destructor.
+     */
+    virtual ~MarkerMap() = default;
+
+    /**
+     * \brief Returning count of markers in the map.
+     * \return Count of markers.
+     */
+    size_t size() const;
+
+    /**
+     * \brief Adding detected markers of a frame with known camera pose. New markers are
+     * initialized from this frame, then every marker seen on the frame is refined over all its
+     * observations (incremental bundle adjustment with fixed camera poses).
+     * \param[in] cameraToWorld Transformation 4x4 from camera to world frame, e.g.
+     * FanucModel::fanucForwardTask(joints) * FanucModel::getToCamera().
+     * \param[in] markerCorners Corners of the detected markers.
+     * \param[in] markerIds Identifiers of the detected markers.
+     */
+    void addFrame(const cv::Mat cameraToWorld,
+                  const std::vector<std::vector<cv::Point2f>>& markerCorners,
+                  const std::vector<int>& markerIds);
+
+    /**
+     * \brief Returning pose of the marker in the world frame.
+     * \param[in] markerId Identifier of the marker.
+     * \param[out] markerToWorld Transformation 4x4 from marker to world frame.
+     * \return True, if the marker is in the map, and false, if not.
+     */
+    bool markerPose(const int markerId, cv::Mat& markerToWorld) const;
+
+    /**
+     * \brief Localizing the camera from all visible markers of the map with one robust PnP.
+     * The pose of the previous successful localization is used as warm start.
+     * \param[in] markerCorners Corners of the detected markers.
+     * \param[in] markerIds Identifiers of the detected markers.
+     * \param[out] cameraToWorld Transformation 4x4 from camera to world frame.
+     * \return Count of markers used for the pose, 0 if the camera was not localized.
+     */
+    int localizeCamera(const std::vector<std::vector<cv::Point2f>>& markerCorners,
+                       const std::vector<int>& markerIds, cv::Mat& cameraToWorld);
+
+    /**
+     * \brief Saving markers poses to a binary file.
+     * \param[in] fileName Name of the file.
+     * \return True, if the map was saved, and false, if not.
+     */
+    bool saveMarkerMap(const std::string& fileName) const;
+
+    /**
+     * \brief Loading markers poses from a binary file written by saveMarkerMap.
+     * Observations are not stored, so loaded markers are refined only with new frames.
+     * \param[in] fileName Name of the file.
+     * \return True, if the map was loaded, and false, if not.
+     */
+    bool loadMarkerMap(const std::string& fileName);
+};
+}
+
+#endif //!ARUCO_MARKER_MAP_2017
@@ -40,6 +40,8 @@ the use of this software, even if advised of the possibility of such damage.
 #include "aruco.hpp"
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+#include <opencv2/core/hal/hal.hpp>
 
 namespace cv {
 namespace aruco {
@@ -72,7 +74,12 @@ DetectorParameters::DetectorParameters()
       perspectiveRemoveIgnoredMarginPerCell(0.13),
       maxErroneousBitsInBorderRate(0.35),
       minOtsuStdDev(5.0),
-      errorCorrectionRate(0.6) {}
+      errorCorrectionRate(0.6),
+      imageDecimation(1.0),
+      candidateEngine(CANDIDATE_ENGINE_CONTOURS),
+      lineSegmentMinMagnitude(40.),
+      lineSegmentMaxAngleDiff(0.35),
+      lineSegmentMaxGapRate(0.5) {}
 
 
 /**
@@ -84,6 +91,41 @@ Ptr<DetectorParameters> DetectorParameters::create() {
 }
 
 
+/**
+  * @brief Create a new set of DetectorParameters with the values of one DetectorPreset.
+  */
+Ptr<DetectorParameters> DetectorParameters::create(int preset) {
+    Ptr<DetectorParameters> params = makePtr<DetectorParameters>();
+    switch(preset) {
+    case DETECTOR_PRESET_FAST:
+        // a single threshold scale on a half-resolution image, coarse bit sampling
+        params->adaptiveThreshWinSizeMin = 7;
+        params->adaptiveThreshWinSizeMax = 7;
+        params->cornerRefinementMethod = CORNER_REFINE_NONE;
+        params->perspectiveRemovePixelPerCell = 2;
+        params->imageDecimation = 2.0;
+        break;
+    case DETECTOR_PRESET_BALANCED:
+        params->cornerRefinementMethod = CORNER_REFINE_SUBPIX;
+        break;
+    case DETECTOR_PRESET_ACCURATE:
+        // seven threshold scales, wider and tighter subpixel refinement, fine bit sampling
+        params->adaptiveThreshWinSizeMin = 3;
+        params->adaptiveThreshWinSizeMax = 33;
+        params->adaptiveThreshWinSizeStep = 5;
+        params->cornerRefinementMethod = CORNER_REFINE_SUBPIX;
+        params->cornerRefinementWinSize = 7;
+        params->cornerRefinementMaxIterations = 100;
+        params->cornerRefinementMinAccuracy = 0.01;
+        params->perspectiveRemovePixelPerCell = 8;
+        break;
+    default:
+        CV_Error(Error::StsBadArg, "Unknown detector preset");
+    }
+    return params;
+}
+
+
 /**
   * @brief Convert input image to gray if it is a 3-channels image
   */
@@ -309,19 +351,28 @@ class DetectInitialCandidatesParallel : public ParallelLoopBody {
 
 
 /**
- * @brief Initial steps on finding square candidates
+ * @brief Number of window sizes (scales) to apply adaptive thresholding
  */
-static void _detectInitialCandidates(const Mat &grey, vector< vector< Point2f > > &candidates,
-                                     vector< vector< Point > > &contours,
-                                     const Ptr<DetectorParameters> &params) {
+static int _getThresholdScales(const Ptr<DetectorParameters> &params) {
 
     CV_Assert(params->adaptiveThreshWinSizeMin >= 3 && params->adaptiveThreshWinSizeMax >= 3);
     CV_Assert(params->adaptiveThreshWinSizeMax >= params->adaptiveThreshWinSizeMin);
     CV_Assert(params->adaptiveThreshWinSizeStep > 0);
 
+    return (params->adaptiveThreshWinSizeMax - params->adaptiveThreshWinSizeMin) /
+               params->adaptiveThreshWinSizeStep + 1;
+}
+
+
+/**
+ * @brief Initial steps on finding square candidates
+ */
+static void _detectInitialCandidates(const Mat &grey, vector< vector< Point2f > > &candidates,
+                                     vector< vector< Point > > &contours,
+                                     const Ptr<DetectorParameters> &params) {
+
     // number of window sizes (scales) to apply adaptive thresholding
-    int nScales =  (params->adaptiveThreshWinSizeMax - params->adaptiveThreshWinSizeMin) /
-                      params->adaptiveThreshWinSizeStep + 1;
+    int nScales = _getThresholdScales(params);
 
     vector< vector< vector< Point2f > > > candidatesArrays((size_t) nScales);
     vector< vector< vector< Point > > > contoursArrays((size_t) nScales);
@@ -353,6 +404,438 @@ static void _detectInitialCandidates(const Mat &grey, vector< vector< Point2f >
 }
 
 
+static Point2f _getCrossPoint(Point3f nLine1, Point3f nLine2);
+
+
+/**
+ * @brief Find the root of a pixel in the union-find forest, compressing the path on the way
+ */
+static int _findRoot(vector< int > &parents, int i) {
+
+    while(parents[i] != i) {
+        parents[i] = parents[parents[i]];
+        i = parents[i];
+    }
+    return i;
+}
+
+
+/**
+ * @brief Gradient statistics of a union-find tree of edge pixels: the range of gradient directions
+ * (relative to the direction of its first pixel) and of gradient magnitudes
+ */
+struct EdgeClusterStats {
+    int size;
+    float theta, thetaMin, thetaMax;
+    float magnitudeMin, magnitudeMax;
+};
+
+
+/**
+ * @brief Join the union-find trees of two edge pixels unless the joined tree would spread its
+ * gradient directions or magnitudes more than the limits (as in AprilTag): the range of the
+ * joined tree may exceed the range of each tree only by k / size, so small trees grow freely and
+ * a large tree does not drift around a corner. The smaller index becomes the root.
+ * @return true if the trees were joined or were the same tree
+ */
+static bool _uniteBounded(vector< int > &parents, vector< EdgeClusterStats > &stats, int a, int b,
+                          float thetaK, float magnitudeK) {
+
+    a = _findRoot(parents, a);
+    b = _findRoot(parents, b);
+    if(a == b) return true;
+    if(b < a) std::swap(a, b);
+    EdgeClusterStats &sa = stats[a], &sb = stats[b];
+
+    // directions of b relative to the first pixel of a
+    float offset = sb.theta - sa.theta;
+    if(offset > (float)CV_PI) offset -= 2.f * (float)CV_PI;
+    else if(offset <= -(float)CV_PI) offset += 2.f * (float)CV_PI;
+    float thetaMin = min(sa.thetaMin, sb.thetaMin + offset);
+    float thetaMax = max(sa.thetaMax, sb.thetaMax + offset);
+    float magnitudeMin = min(sa.magnitudeMin, sb.magnitudeMin);
+    float magnitudeMax = max(sa.magnitudeMax, sb.magnitudeMax);
+
+    float thetaBound = min(sa.thetaMax - sa.thetaMin + thetaK / sa.size,
+                           sb.thetaMax - sb.thetaMin + thetaK / sb.size);
+    float magnitudeBound = min(sa.magnitudeMax - sa.magnitudeMin + magnitudeK / sa.size,
+                               sb.magnitudeMax - sb.magnitudeMin + magnitudeK / sb.size);
+    if(thetaMax - thetaMin > thetaBound || magnitudeMax - magnitudeMin > magnitudeBound)
+        return false;
+
+    parents[b] = a;
+    sa.size += sb.size;
+    sa.thetaMin = thetaMin;
+    sa.thetaMax = thetaMax;
+    sa.magnitudeMin = magnitudeMin;
+    sa.magnitudeMax = magnitudeMax;
+    return true;
+}
+
+
+/**
+ * @brief Absolute difference of two angles in radians, in the range [0, pi]
+ */
+static float _angleDifference(float a, float b) {
+
+    float diff = std::abs(a - b);
+    return diff > (float)CV_PI ? 2.f * (float)CV_PI - diff : diff;
+}
+
+
+/**
+ * @brief Weighted moments of a cluster of edge pixels, used to fit its line segment
+ */
+struct LineSegmentCluster {
+    int nPixels;
+    double weight, sumX, sumY, sumXX, sumXY, sumYY, gradX, gradY;
+    float minT, maxT;
+    Point2f center, direction;
+};
+
+
+/**
+ * @brief Line segment oriented so that the image gradient points to its left side. Following
+ * the segments of a dark marker on a bright background then always turns the same way.
+ */
+struct LineSegment {
+    Point2f start, end, direction;
+    float length;
+};
+
+
+/**
+ * @brief Find square candidates from gradient line segments (in the style of AprilTag): edge
+ * pixels with similar gradient direction are clustered with a bounded union-find, a segment is
+ * fitted to each cluster and closed chains of four segments become candidates. Runs once on the image,
+ * without thresholding, and tolerates a gap between the segments of two adjacent sides.
+ */
+static void _detectLineSegmentCandidates(const Mat &grey, vector< vector< Point2f > > &candidates,
+                                         vector< vector< Point > > &contours,
+                                         const Ptr<DetectorParameters> &params) {
+
+    CV_Assert(params->lineSegmentMinMagnitude > 0 && params->lineSegmentMaxAngleDiff > 0 &&
+              params->lineSegmentMaxGapRate >= 0);
+    CV_Assert(params->minMarkerPerimeterRate > 0 && params->maxMarkerPerimeterRate > 0 &&
+              params->minCornerDistanceRate >= 0 && params->minDistanceToBorder >= 0);
+
+    // calculate maximum and minimum sizes in pixels
+    unsigned int minPerimeterPixels =
+        (unsigned int)(params->minMarkerPerimeterRate * max(grey.cols, grey.rows));
+    unsigned int maxPerimeterPixels =
+        (unsigned int)(params->maxMarkerPerimeterRate * max(grey.cols, grey.rows));
+    float minSegmentLength = max(4.f, float(minPerimeterPixels) / 8.f);
+
+    /// 1. GRADIENT MAGNITUDE AND DIRECTION
+    Mat smooth, dx, dy, magnitude, angle;
+    GaussianBlur(grey, smooth, Size(5, 5), 0.8);
+    Sobel(smooth, dx, CV_32F, 1, 0);
+    Sobel(smooth, dy, CV_32F, 0, 1);
+    cartToPolar(dx, dy, magnitude, angle);
+
+    /// 2. CLUSTER NEIGHBOUR EDGE PIXELS WITH SIMILAR GRADIENT DIRECTION
+    const int cols = grey.cols;
+    const float minMagnitude = (float)params->lineSegmentMinMagnitude;
+    const float maxAngleDiff = (float)params->lineSegmentMaxAngleDiff;
+    // growth limits of the direction range (radians) and magnitude range of a cluster, divided by
+    // its size; magnitudes of a 0..255 step edge reach ~1000
+    const float thetaK = 100.f, magnitudeK = 10000.f;
+
+    // edge pixels are numbered, the union-find forest holds only them
+    vector< int > edgeIndex(grey.total(), -1);
+    vector< Point > edgePixels;
+    vector< EdgeClusterStats > stats;
+    for(int y = 0; y < grey.rows; y++) {
+        const float *mag = magnitude.ptr< float >(y);
+        const float *theta = angle.ptr< float >(y);
+        for(int x = 0; x < cols; x++) {
+            if(mag[x] <= minMagnitude) continue;
+            edgeIndex[y * cols + x] = (int)edgePixels.size();
+            edgePixels.push_back(Point(x, y));
+            EdgeClusterStats pixelStats = { 1, theta[x], 0.f, 0.f, mag[x], mag[x] };
+            stats.push_back(pixelStats);
+        }
+    }
+    const int nEdges = (int)edgePixels.size();
+
+    // pairs of neighbour pixels, forward neighbours only so that every pair is taken once, sorted
+    // by direction difference with a counting sort: the most similar pixels are joined first
+    const int nBuckets = 64;
+    const int neighbours[4][2] = { { 1, 0 }, { -1, 1 }, { 0, 1 }, { 1, 1 } };
+    vector< Vec2i > pairs;
+    vector< uchar > pairBuckets;
+    vector< int > bucketStart(nBuckets + 1, 0);
+    for(int e = 0; e < nEdges; e++) {
+        int x = edgePixels[e].x, y = edgePixels[e].y;
+        for(int n = 0; n < 4; n++) {
+            int nx = x + neighbours[n][0], ny = y + neighbours[n][1];
+            if(nx < 0 || nx >= cols || ny >= grey.rows) continue;
+            int nEdge = edgeIndex[ny * cols + nx];
+            if(nEdge < 0) continue;
+            float diff = _angleDifference(stats[e].theta, stats[nEdge].theta);
+            if(diff >= maxAngleDiff) continue;
+            int bucket = min(nBuckets - 1, (int)(diff / maxAngleDiff * nBuckets));
+            pairs.push_back(Vec2i(e, nEdge));
+            pairBuckets.push_back((uchar)bucket);
+            bucketStart[bucket + 1]++;
+        }
+    }
+    for(int b = 0; b < nBuckets; b++)
+        bucketStart[b + 1] += bucketStart[b];
+    vector< Vec2i > sortedPairs(pairs.size());
+    for(size_t i = 0; i < pairs.size(); i++)
+        sortedPairs[bucketStart[pairBuckets[i]]++] = pairs[i];
+
+    vector< int > parents((size_t)nEdges);
+    for(int e = 0; e < nEdges; e++)
+        parents[e] = e;
+    for(size_t i = 0; i < sortedPairs.size(); i++)
+        _uniteBounded(parents, stats, sortedPairs[i][0], sortedPairs[i][1], thetaK, magnitudeK);
+
+    /// 3. FIT ONE LINE SEGMENT TO EACH CLUSTER
+    vector< int > labels((size_t)nEdges, -1);
+    vector< LineSegmentCluster > clusters;
+    for(int e = 0; e < nEdges; e++) {
+        int x = edgePixels[e].x, y = edgePixels[e].y;
+        int root = _findRoot(parents, e);
+        if(labels[root] < 0) {
+            labels[root] = (int)clusters.size();
+            clusters.push_back(LineSegmentCluster());
+            clusters.back().minT = FLT_MAX;
+            clusters.back().maxT = -FLT_MAX;
+        }
+        LineSegmentCluster &cluster = clusters[labels[root]];
+        double w = magnitude.ptr< float >(y)[x];
+        cluster.nPixels++;
+        cluster.weight += w;
+        cluster.sumX += w * x;
+        cluster.sumY += w * y;
+        cluster.sumXX += w * x * x;
+        cluster.sumXY += w * x * y;
+        cluster.sumYY += w * y * y;
+        cluster.gradX += dx.ptr< float >(y)[x];
+        cluster.gradY += dy.ptr< float >(y)[x];
+    }
+
+    // principal direction of each cluster, turned so that the mean gradient is on its left
+    for(unsigned int i = 0; i < clusters.size(); i++) {
+        LineSegmentCluster &cluster = clusters[i];
+        double cx = cluster.sumX / cluster.weight, cy = cluster.sumY / cluster.weight;
+        double cxx = cluster.sumXX / cluster.weight - cx * cx;
+        double cxy = cluster.sumXY / cluster.weight - cx * cy;
+        double cyy = cluster.sumYY / cluster.weight - cy * cy;
+        double theta = 0.5 * atan2(2 * cxy, cxx - cyy);
+        cluster.center = Point2f((float)cx, (float)cy);
+        cluster.direction = Point2f((float)cos(theta), (float)sin(theta));
+        if(cluster.direction.x * cluster.gradY - cluster.direction.y * cluster.gradX < 0)
+            cluster.direction = -cluster.direction;
+    }
+
+    // extent of each cluster along its direction
+    for(int e = 0; e < nEdges; e++) {
+        LineSegmentCluster &cluster = clusters[labels[_findRoot(parents, e)]];
+        float t = (Point2f(edgePixels[e]) - cluster.center).dot(cluster.direction);
+        cluster.minT = min(cluster.minT, t);
+        cluster.maxT = max(cluster.maxT, t);
+    }
+
+    vector< LineSegment > segments;
+    for(unsigned int i = 0; i < clusters.size(); i++) {
+        const LineSegmentCluster &cluster = clusters[i];
+        float length = cluster.maxT - cluster.minT;
+        if(cluster.nPixels < 4 || length < minSegmentLength) continue;
+        LineSegment segment;
+        segment.start = cluster.center + cluster.minT * cluster.direction;
+        segment.end = cluster.center + cluster.maxT * cluster.direction;
+        segment.direction = cluster.direction;
+        segment.length = length;
+        segments.push_back(segment);
+    }
+
+    /// 4. LINK EACH SEGMENT TO THE SEGMENTS STARTING NEAR ITS END WITH A CONVEX TURN
+    // the gap may be up to the rate of the longer segment, so the starts near the end of every
+    // segment and the ends near the start of every segment are looked up in a grid of cells
+    int nSegments = (int)segments.size();
+    const float maxGapRate = float(params->lineSegmentMaxGapRate);
+    const float cellSize = max(minSegmentLength, 4.f);
+    const int gridCols = int(cols / cellSize) + 1, gridRows = int(grey.rows / cellSize) + 1;
+    vector< vector< int > > startCells((size_t)(gridCols * gridRows));
+    vector< vector< int > > endCells((size_t)(gridCols * gridRows));
+    const auto cellOf = [&](const Point2f &point, int &cellX, int &cellY) {
+        cellX = min(max(int(point.x / cellSize), 0), gridCols - 1);
+        cellY = min(max(int(point.y / cellSize), 0), gridRows - 1);
+    };
+    for(int i = 0; i < nSegments; i++) {
+        int cellX, cellY;
+        cellOf(segments[i].start, cellX, cellY);
+        startCells[cellY * gridCols + cellX].push_back(i);
+        cellOf(segments[i].end, cellX, cellY);
+        endCells[cellY * gridCols + cellX].push_back(i);
+    }
+
+    vector< vector< int > > children((size_t)nSegments);
+    const auto link = [&](int i, int j) {
+        if(i == j) return;
+        float maxGap = maxGapRate * max(segments[i].length, segments[j].length);
+        Point2f gap = segments[j].start - segments[i].end;
+        if(gap.dot(gap) > maxGap * maxGap) return;
+        // at least ~15 degrees of turn, in the direction of a dark quad on bright background
+        float turn = segments[i].direction.x * segments[j].direction.y -
+                     segments[i].direction.y * segments[j].direction.x;
+        if(turn > -0.25f) return;
+        children[i].push_back(j);
+    };
+    const auto linkNear = [&](const vector< vector< int > > &cells, const Point2f &point,
+                              float radius, int segment, bool fromEnd) {
+        int minX, minY, maxX, maxY;
+        cellOf(point - Point2f(radius, radius), minX, minY);
+        cellOf(point + Point2f(radius, radius), maxX, maxY);
+        for(int cellY = minY; cellY <= maxY; cellY++) {
+            for(int cellX = minX; cellX <= maxX; cellX++) {
+                const vector< int > &cell = cells[cellY * gridCols + cellX];
+                for(size_t k = 0; k < cell.size(); k++) {
+                    if(fromEnd) link(segment, cell[k]);
+                    else link(cell[k], segment);
+                }
+            }
+        }
+    };
+    for(int i = 0; i < nSegments; i++) {
+        float radius = maxGapRate * segments[i].length;
+        linkNear(startCells, segments[i].end, radius, i, true);
+        linkNear(endCells, segments[i].start, radius, i, false);
+    }
+    // a pair within the rate of both segments is found from both of them
+    for(int i = 0; i < nSegments; i++) {
+        sort(children[i].begin(), children[i].end());
+        children[i].erase(unique(children[i].begin(), children[i].end()), children[i].end());
+    }
+
+    /// 5. CLOSED CHAINS OF FOUR SEGMENTS ARE THE CANDIDATES
+    Point3f lines[4];
+    for(int a = 0; a < nSegments; a++) {
+        for(unsigned int ib = 0; ib < children[a].size(); ib++) {
+            int b = children[a][ib];
+            if(b < a) continue; // every chain is found once, from its smallest segment
+            for(unsigned int ic = 0; ic < children[b].size(); ic++) {
+                int c = children[b][ic];
+                if(c < a) continue;
+                for(unsigned int id = 0; id < children[c].size(); id++) {
+                    int d = children[c][id];
+                    if(d < a || d == b) continue;
+                    if(find(children[d].begin(), children[d].end(), a) == children[d].end())
+                        continue;
+
+                    // corners are the intersections of consecutive segment lines
+                    int chain[4] = { a, b, c, d };
+                    for(int k = 0; k < 4; k++) {
+                        const LineSegment &segment = segments[chain[k]];
+                        Point2f normal(-segment.direction.y, segment.direction.x);
+                        lines[k] = Point3f(normal.x, normal.y, -normal.dot(segment.start));
+                    }
+                    vector< Point2f > quad(4);
+                    for(int k = 0; k < 4; k++)
+                        quad[k] = _getCrossPoint(lines[k], lines[(k + 1) % 4]);
+
+                    // check is convex and is not too near to the image border
+                    if(!isContourConvex(quad)) continue;
+                    bool tooNearBorder = false;
+                    for(int k = 0; k < 4; k++) {
+                        if(quad[k].x < params->minDistanceToBorder ||
+                           quad[k].y < params->minDistanceToBorder ||
+                           quad[k].x > grey.cols - 1 - params->minDistanceToBorder ||
+                           quad[k].y > grey.rows - 1 - params->minDistanceToBorder)
+                            tooNearBorder = true;
+                    }
+                    if(tooNearBorder) continue;
+
+                    // pixel contour along the quad sides, used as perimeter and by the contour
+                    // corner refinement
+                    vector< Point > contour;
+                    for(int k = 0; k < 4; k++) {
+                        LineIterator it(grey, Point(quad[k]), Point(quad[(k + 1) % 4]));
+                        for(int p = 0; p < it.count - 1; p++, ++it)
+                            contour.push_back(it.pos());
+                    }
+                    if(contour.size() < minPerimeterPixels || contour.size() > maxPerimeterPixels)
+                        continue;
+
+                    // check min distance between corners
+                    double minDistSq = DBL_MAX;
+                    for(int k = 0; k < 4; k++) {
+                        Point2f side = quad[k] - quad[(k + 1) % 4];
+                        minDistSq = min(minDistSq, (double)side.dot(side));
+                    }
+                    double minCornerDistancePixels =
+                        double(contour.size()) * params->minCornerDistanceRate;
+                    if(minDistSq < minCornerDistancePixels * minCornerDistancePixels) continue;
+
+                    candidates.push_back(quad);
+                    contours.push_back(contour);
+                }
+            }
+        }
+    }
+}
+
+
+/**
+ * @brief Scale candidates and contours found on a decimated image back to the original size.
+ * Pixel centres are mapped, (x + 0.5) * scale - 0.5; corners keep their subpixel position, the
+ * contour refinement starts from the contour point closest to each corner.
+ */
+static void _scaleCandidates(vector< vector< Point2f > > &candidates,
+                             vector< vector< Point > > &contours, double scale) {
+
+    const float fscale = (float)scale;
+    for(unsigned int i = 0; i < candidates.size(); i++) {
+        for(unsigned int j = 0; j < candidates[i].size(); j++) {
+            candidates[i][j] = Point2f((candidates[i][j].x + 0.5f) * fscale - 0.5f,
+                                       (candidates[i][j].y + 0.5f) * fscale - 0.5f);
+        }
+        for(unsigned int j = 0; j < contours[i].size(); j++) {
+            contours[i][j] = Point(cvRound((contours[i][j].x + 0.5) * scale - 0.5),
+                                   cvRound((contours[i][j].y + 0.5) * scale - 0.5));
+        }
+    }
+}
+
+
+/**
+ * @brief Image the candidates are searched on: the grey image, downscaled by imageDecimation
+ */
+static Mat _getSearchImage(const Mat &grey, const Ptr<DetectorParameters> &_params) {
+
+    Mat searchImage = grey;
+    if(_params->imageDecimation > 1)
+        resize(grey, searchImage, Size(), 1. / _params->imageDecimation,
+               1. / _params->imageDecimation, INTER_AREA);
+    return searchImage;
+}
+
+
+/**
+ * @brief Last steps on finding square candidates: bring them back to full resolution, sort their
+ * corners and filter out near candidate pairs
+ */
+static void _finishCandidates(vector< vector< Point2f > > &candidates,
+                              vector< vector< Point > > &contours,
+                              vector< vector< Point2f > >& candidatesOut,
+                              vector< vector< Point > >& contoursOut,
+                              const Ptr<DetectorParameters> &_params) {
+
+    if(_params->imageDecimation > 1)
+        _scaleCandidates(candidates, contours, _params->imageDecimation);
+
+    /// SORT CORNERS
+    _reorderCandidatesCorners(candidates);
+
+    /// FILTER OUT NEAR CANDIDATE PAIRS
+    _filterTooCloseCandidates(candidates, candidatesOut, contours, contoursOut,
+                              _params->minMarkerDistanceRate);
+}
+
+
 /**
  * @brief Detect square candidates in the input image
  */
@@ -369,14 +852,16 @@ static void _detectCandidates(InputArray _image, vector< vector< Point2f > >& ca
     vector< vector< Point2f > > candidates;
     vector< vector< Point > > contours;
     /// 2. DETECT FIRST SET OF CANDIDATES
-    _detectInitialCandidates(grey, candidates, contours, _params);
+    // search on the downscaled image and bring the candidates back to full resolution
+    Mat searchImage = _getSearchImage(grey, _params);
 
-    /// 3. SORT CORNERS
-    _reorderCandidatesCorners(candidates);
+    if(_params->candidateEngine == CANDIDATE_ENGINE_LINE_SEGMENTS)
+        _detectLineSegmentCandidates(searchImage, candidates, contours, _params);
+    else
+        _detectInitialCandidates(searchImage, candidates, contours, _params);
 
-    /// 4. FILTER OUT NEAR CANDIDATE PAIRS
-    _filterTooCloseCandidates(candidates, candidatesOut, contours, contoursOut,
-                              _params->minMarkerDistanceRate);
+    /// 3. SCALE, SORT CORNERS AND FILTER OUT NEAR CANDIDATE PAIRS
+    _finishCandidates(candidates, contours, candidatesOut, contoursOut, _params);
 }
 
 
@@ -478,10 +963,12 @@ static int _getBorderErrors(const Mat &bits, int markerSize, int borderSize) {
 
 
 /**
- * @brief Tries to identify one candidate given the dictionary
+ * @brief Tries to identify one candidate given the dictionary. The candidate takes the id of the
+ * closest marker, confidence holds its Hamming distance, the distance of the closest other id and
+ * the border errors
  */
 static bool _identifyOneCandidate(const Ptr<Dictionary>& dictionary, InputArray _image,
-                                  vector<Point2f>& _corners, int& idx,
+                                  vector<Point2f>& _corners, int& idx, Vec3i& confidence,
                                   const Ptr<DetectorParameters>& params)
 {
     CV_Assert(_corners.size() == 4);
@@ -507,10 +994,12 @@ static bool _identifyOneCandidate(const Ptr<Dictionary>& dictionary, InputArray
                                candidateBits.rows - params->markerBorderBits)
             .colRange(params->markerBorderBits, candidateBits.rows - params->markerBorderBits);
 
-    // try to indentify the marker
-    int rotation;
-    if(!dictionary->identify(onlyBits, idx, rotation, params->errorCorrectionRate))
-        return false;
+    // try to indentify the marker: most candidates are not markers and are rejected by the
+    // budget-pruned search, only the accepted ones pay for the closest and runner-up search
+    int rotation, distance, secondDistance;
+    if(!dictionary->identify(onlyBits, idx, rotation, params->errorCorrectionRate)) return false;
+    dictionary->identifyClosest(onlyBits, idx, rotation, distance, secondDistance);
+    confidence = Vec3i(distance, secondDistance, borderErrors);
 
     // shift corner positions to the correct rotation
     if(rotation != 0) {
@@ -528,10 +1017,12 @@ class IdentifyCandidatesParallel : public ParallelLoopBody {
     public:
     IdentifyCandidatesParallel(const Mat& _grey, vector< vector< Point2f > >& _candidates,
                                const Ptr<Dictionary> &_dictionary,
-                               vector< int >& _idsTmp, vector< char >& _validCandidates,
+                               vector< int >& _idsTmp, vector< Vec3i >& _confidencesTmp,
+                               vector< char >& _validCandidates,
                                const Ptr<DetectorParameters> &_params)
         : grey(_grey), candidates(_candidates), dictionary(_dictionary),
-          idsTmp(_idsTmp), validCandidates(_validCandidates), params(_params) {}
+          idsTmp(_idsTmp), confidencesTmp(_confidencesTmp), validCandidates(_validCandidates),
+          params(_params) {}
 
     void operator()(const Range &range) const {
         const int begin = range.start;
@@ -539,7 +1030,8 @@ class IdentifyCandidatesParallel : public ParallelLoopBody {
 
         for(int i = begin; i < end; i++) {
             int currId;
-            if(_identifyOneCandidate(dictionary, grey, candidates[i], currId, params)) {
+            if(_identifyOneCandidate(dictionary, grey, candidates[i], currId, confidencesTmp[i],
+                                     params)) {
                 validCandidates[i] = 1;
                 idsTmp[i] = currId;
             }
@@ -553,6 +1045,7 @@ class IdentifyCandidatesParallel : public ParallelLoopBody {
     vector< vector< Point2f > >& candidates;
     const Ptr<Dictionary> &dictionary;
     vector< int > &idsTmp;
+    vector< Vec3i > &confidencesTmp;
     vector< char > &validCandidates;
     const Ptr<DetectorParameters> &params;
 };
@@ -600,6 +1093,7 @@ static void _copyVector2Output(vector< vector< Point2f > > &vec, OutputArrayOfAr
 static void _identifyCandidates(InputArray _image, vector< vector< Point2f > >& _candidates,
                                 vector< vector<Point> >& _contours, const Ptr<Dictionary> &_dictionary,
                                 vector< vector< Point2f > >& _accepted, vector< int >& ids,
+                                vector< Vec3i >& confidences,
                                 const Ptr<DetectorParameters> &params,
                                 OutputArrayOfArrays _rejected = noArray()) {
 
@@ -616,6 +1110,7 @@ static void _identifyCandidates(InputArray _image, vector< vector< Point2f > >&
     _convertToGrey(_image.getMat(), grey);
 
     vector< int > idsTmp(ncandidates, -1);
+    vector< Vec3i > confidencesTmp(ncandidates);
     vector< char > validCandidates(ncandidates, 0);
 
     //// Analyze each of the candidates
@@ -631,12 +1126,13 @@ static void _identifyCandidates(InputArray _image, vector< vector< Point2f > >&
     // this is the parallel call for the previous commented loop (result is equivalent)
     parallel_for_(Range(0, ncandidates),
                   IdentifyCandidatesParallel(grey, _candidates, _dictionary, idsTmp,
-                                             validCandidates, params));
+                                             confidencesTmp, validCandidates, params));
 
     for(int i = 0; i < ncandidates; i++) {
         if(validCandidates[i] == 1) {
             accepted.push_back(_candidates[i]);
             ids.push_back(idsTmp[i]);
+            confidences.push_back(confidencesTmp[i]);
 
             contours.push_back(_contours[i]);
 
@@ -659,7 +1155,8 @@ static void _identifyCandidates(InputArray _image, vector< vector< Point2f > >&
 /**
   * @brief Final filter of markers after its identification
   */
-static void _filterDetectedMarkers(vector< vector< Point2f > >& _corners, vector< int >& _ids, vector< vector< Point> >& _contours) {
+static void _filterDetectedMarkers(vector< vector< Point2f > >& _corners, vector< int >& _ids,
+                                   vector< Vec3i >& _confidences, vector< vector< Point> >& _contours) {
 
     CV_Assert(_corners.size() == _ids.size());
     if(_corners.empty()) return;
@@ -709,6 +1206,7 @@ static void _filterDetectedMarkers(vector< vector< Point2f > >& _corners, vector
     if(atLeastOneRemove) {
         vector< vector< Point2f > >::iterator filteredCorners = _corners.begin();
         vector< int >::iterator filteredIds = _ids.begin();
+        vector< Vec3i >::iterator filteredConfidences = _confidences.begin();
 
         vector< vector< Point > >::iterator filteredContours = _contours.begin();
 
@@ -716,12 +1214,14 @@ static void _filterDetectedMarkers(vector< vector< Point2f > >& _corners, vector
             if(!toRemove[i]) {
                 *filteredCorners++ = _corners[i];
                 *filteredIds++ = _ids[i];
+                *filteredConfidences++ = _confidences[i];
 
                 *filteredContours++ = _contours[i];
             }
         }
 
         _ids.erase(filteredIds, _ids.end());
+        _confidences.erase(filteredConfidences, _confidences.end());
         _corners.erase(filteredCorners, _corners.end());
 
         _contours.erase(filteredContours, _contours.end());
@@ -750,25 +1250,169 @@ static void _getSingleMarkerObjectPoints(float markerLength, OutputArray _objPoi
 
 
 /**
-  * ParallelLoopBody class for the parallelization of the marker corner subpixel refinement
+  * @brief Weights of the corner subpixel window shared by all the corners of one detection, the
+  * same gaussian weighting as cornerSubPix. weightedX/weightedY hold the weight times the pixel
+  * offset from the window center.
+  */
+struct CornerSubpixelWindow {
+    int halfSize, size;
+    vector< float > weights, weightedX, weightedY;
+
+    CornerSubpixelWindow(int _halfSize) : halfSize(_halfSize), size(2 * _halfSize + 1) {
+        vector< float > weights1D((size_t)size);
+        double coeff = 1. / (halfSize * halfSize);
+        for(int i = 0; i < size; i++)
+            weights1D[i] = (float)exp(-(i - halfSize) * (i - halfSize) * coeff);
+
+        weights.resize((size_t)size * size);
+        weightedX.resize(weights.size());
+        weightedY.resize(weights.size());
+        for(int y = 0; y < size; y++) {
+            for(int x = 0; x < size; x++) {
+                float w = weights1D[x] * weights1D[y];
+                weights[y * size + x] = w;
+                weightedX[y * size + x] = w * float(x - halfSize);
+                weightedY[y * size + x] = w * float(y - halfSize);
+            }
+        }
+    }
+};
+
+
+/**
+  * @brief Accumulate the weighted gradient products of one window:
+  * sums = (sum w*gx*gx, sum w*gx*gy, sum w*gy*gy, sum w*(gx*gx*x + gx*gy*y), sum w*(gx*gy*x + gy*gy*y))
+  */
+static void _accumulateCornerSums(const float *gx, const float *gy, const CornerSubpixelWindow &window,
+                                  double sums[5]) {
+
+    const float *w = &window.weights[0];
+    const float *wx = &window.weightedX[0];
+    const float *wy = &window.weightedY[0];
+    int n = window.size * window.size;
+    int i = 0;
+    float a = 0, b = 0, c = 0, bb1 = 0, bb2 = 0;
+#if CV_SIMD128
+    v_float32x4 va = v_setzero_f32(), vb = v_setzero_f32(), vc = v_setzero_f32();
+    v_float32x4 vbb1 = v_setzero_f32(), vbb2 = v_setzero_f32();
+    for(; i <= n - 4; i += 4) {
+        v_float32x4 x = v_load(gx + i), y = v_load(gy + i);
+        v_float32x4 xx = x * x, xy = x * y, yy = y * y;
+        v_float32x4 vw = v_load(w + i), vwx = v_load(wx + i), vwy = v_load(wy + i);
+        va += xx * vw;
+        vb += xy * vw;
+        vc += yy * vw;
+        vbb1 += xx * vwx + xy * vwy;
+        vbb2 += xy * vwx + yy * vwy;
+    }
+    a = v_reduce_sum(va);
+    b = v_reduce_sum(vb);
+    c = v_reduce_sum(vc);
+    bb1 = v_reduce_sum(vbb1);
+    bb2 = v_reduce_sum(vbb2);
+#endif
+    for(; i < n; i++) {
+        float xx = gx[i] * gx[i], xy = gx[i] * gy[i], yy = gy[i] * gy[i];
+        a += xx * w[i];
+        b += xy * w[i];
+        c += yy * w[i];
+        bb1 += xx * wx[i] + xy * wy[i];
+        bb2 += xy * wx[i] + yy * wy[i];
+    }
+    sums[0] = a;
+    sums[1] = b;
+    sums[2] = c;
+    sums[3] = bb1;
+    sums[4] = bb2;
+}
+
+
+/**
+  * @brief Iterative subpixel refinement of one corner, the same iteration as cornerSubPix with
+  * shared window weights and no allocations. Stops as soon as the corner moves less than
+  * minAccuracy. buffer must hold (window.size + 2)^2 + 2 * window.size^2 floats.
+  */
+static void _refineCornerSubpix(const Mat &grey, Point2f &corner, const CornerSubpixelWindow &window,
+                                int maxIterations, double minAccuracy, float *buffer) {
+
+    const int halfSize = window.halfSize, size = window.size;
+    const int sampledSize = size + 2; // one extra pixel on each side for the central differences
+    float *sampled = buffer;
+    float *gx = sampled + sampledSize * sampledSize;
+    float *gy = gx + size * size;
+    Mat sampledMat(sampledSize, sampledSize, CV_32F, sampled);
+
+    double eps = minAccuracy * minAccuracy;
+    Point2f initial = corner, current = corner;
+    for(int iter = 0; iter < maxIterations; iter++) {
+        // bilinear sampling of the window, every pixel has the same interpolation weights
+        Point2f topLeft = current - Point2f(float(halfSize + 1), float(halfSize + 1));
+        int ix = cvFloor(topLeft.x), iy = cvFloor(topLeft.y);
+        if(ix >= 0 && iy >= 0 && ix + sampledSize < grey.cols && iy + sampledSize < grey.rows) {
+            float fx = topLeft.x - ix, fy = topLeft.y - iy;
+            float w00 = (1.f - fx) * (1.f - fy), w01 = fx * (1.f - fy);
+            float w10 = (1.f - fx) * fy, w11 = fx * fy;
+            for(int y = 0; y < sampledSize; y++) {
+                const uchar *row0 = grey.ptr< uchar >(iy + y) + ix;
+                const uchar *row1 = grey.ptr< uchar >(iy + y + 1) + ix;
+                float *dst = sampled + y * sampledSize;
+                for(int x = 0; x < sampledSize; x++)
+                    dst[x] = w00 * row0[x] + w01 * row0[x + 1] + w10 * row1[x] + w11 * row1[x + 1];
+            }
+        }
+        else
+            getRectSubPix(grey, sampledMat.size(), current, sampledMat, CV_32F);
+
+        // gradient window by central differences
+        for(int y = 0; y < size; y++) {
+            const float *row = sampled + (y + 1) * sampledSize + 1;
+            for(int x = 0; x < size; x++) {
+                gx[y * size + x] = row[x + 1] - row[x - 1];
+                gy[y * size + x] = row[x + sampledSize] - row[x - sampledSize];
+            }
+        }
+
+        double sums[5];
+        _accumulateCornerSums(gx, gy, window, sums);
+        double det = sums[0] * sums[2] - sums[1] * sums[1];
+        if(fabs(det) <= DBL_EPSILON * DBL_EPSILON) break;
+
+        double scale = 1. / det;
+        Point2f next((float)(current.x + (sums[2] * sums[3] - sums[1] * sums[4]) * scale),
+                     (float)(current.y + (sums[0] * sums[4] - sums[1] * sums[3]) * scale));
+        Point2f shift = next - current;
+        current = next;
+        if(current.x < 0 || current.x >= grey.cols || current.y < 0 || current.y >= grey.rows)
+            break;
+        if(shift.dot(shift) <= eps) break;
+    }
+
+    // do not move the corner further than the window
+    if(fabs(current.x - initial.x) > halfSize || fabs(current.y - initial.y) > halfSize)
+        current = initial;
+    corner = current;
+}
+
+
+/**
+  * ParallelLoopBody class for the parallelization of the marker corner subpixel refinement, one
+  * task per corner of all the markers
   * Called from function detectMarkers()
   */
 class MarkerSubpixelParallel : public ParallelLoopBody {
     public:
-    MarkerSubpixelParallel(const Mat *_grey, OutputArrayOfArrays _corners,
-                           const Ptr<DetectorParameters> &_params)
-        : grey(_grey), corners(_corners), params(_params) {}
+    MarkerSubpixelParallel(const Mat *_grey, vector< vector< Point2f > > &_corners,
+                           const CornerSubpixelWindow &_window, const Ptr<DetectorParameters> &_params)
+        : grey(_grey), corners(_corners), window(_window), params(_params) {}
 
     void operator()(const Range &range) const {
-        const int begin = range.start;
-        const int end = range.end;
+        int sampledSize = window.size + 2;
+        AutoBuffer< float > buffer((size_t)(sampledSize * sampledSize + 2 * window.size * window.size));
 
-        for(int i = begin; i < end; i++) {
-            cornerSubPix(*grey, corners.getMat(i),
-                         Size(params->cornerRefinementWinSize, params->cornerRefinementWinSize),
-                         Size(-1, -1), TermCriteria(TermCriteria::MAX_ITER | TermCriteria::EPS,
-                                                    params->cornerRefinementMaxIterations,
-                                                    params->cornerRefinementMinAccuracy));
+        for(int i = range.start; i < range.end; i++) {
+            _refineCornerSubpix(*grey, corners[i / 4][i % 4], window,
+                                params->cornerRefinementMaxIterations,
+                                params->cornerRefinementMinAccuracy, buffer);
         }
     }
 
@@ -776,51 +1420,57 @@ class MarkerSubpixelParallel : public ParallelLoopBody {
     MarkerSubpixelParallel &operator=(const MarkerSubpixelParallel &); // to quiet MSVC
 
     const Mat *grey;
-    OutputArrayOfArrays corners;
+    vector< vector< Point2f > > &corners;
+    const CornerSubpixelWindow &window;
     const Ptr<DetectorParameters> &params;
 };
 
 /**
- * Line fitting  A * B = C :: Called from function refineCandidateLines
- * @param nContours, contour-container
+ * Sums of one side of the contour, for the closed-form line fit :: Called from function refineCandidateLines
  */
-static Point3f _interpolate2Dline(const std::vector<cv::Point2f>& nContours){
+struct LineFitSums {
+	double n, sx, sy, sxx, sxy, syy;
 	float minX, minY, maxX, maxY;
-	minX = maxX = nContours[0].x;
-	minY = maxY = nContours[0].y;
-
-	for(unsigned int i = 0; i< nContours.size(); i++){
-		minX = nContours[i].x < minX ? nContours[i].x : minX;
-		minY = nContours[i].y < minY ? nContours[i].y : minY;
-		maxX = nContours[i].x > maxX ? nContours[i].x : maxX;
-		maxY = nContours[i].y > maxY ? nContours[i].y : maxY;
-	}
-
-	Mat A = Mat::ones((int)nContours.size(), 2, CV_32F); // Coefficient Matrix (N x 2)
-	Mat B((int)nContours.size(), 1, CV_32F);				// Variables   Matrix (N x 1)
-	Mat C;											// Constant
-
-	if(maxX - minX > maxY - minY){
-		for(unsigned int i =0; i < nContours.size(); i++){
-            A.at<float>(i,0)= nContours[i].x;
-            B.at<float>(i,0)= nContours[i].y;
-		}
+};
 
-		solve(A, B, C, DECOMP_NORMAL);
+/**
+ * Accumulate the points [begin, end) of the flat coordinate arrays into the line sums
+ * @param xs, x coordinates of the contour points
+ * @param ys, y coordinates of the contour points
+ */
+static void _accumulateLineSums(const float* xs, const float* ys, int begin, int end, LineFitSums& sums){
+	double sx = 0, sy = 0, sxx = 0, sxy = 0, syy = 0;
+	float minX = sums.minX, minY = sums.minY, maxX = sums.maxX, maxY = sums.maxY;
+	// plain loop over contiguous arrays, vectorized by the compiler
+	for(int i = begin; i < end; i++){
+		float x = xs[i], y = ys[i];
+		sx += x; sy += y;
+		sxx += x * x; sxy += x * y; syy += y * y;
+		minX = min(minX, x); maxX = max(maxX, x);
+		minY = min(minY, y); maxY = max(maxY, y);
+	}
+	sums.n += end - begin;
+	sums.sx += sx; sums.sy += sy;
+	sums.sxx += sxx; sums.sxy += sxy; sums.syy += syy;
+	sums.minX = minX; sums.minY = minY; sums.maxX = maxX; sums.maxY = maxY;
+}
 
-		return Point3f(C.at<float>(0, 0), -1., C.at<float>(1, 0));
+/**
+ * Closed-form least-squares line fit y = a*x + b (or x = a*y + b for steep sides), the same line
+ * that solve() returned for the normal equations :: Called from function refineCandidateLines
+ * @param sums, sums of the side points
+ */
+static Point3f _interpolate2Dline(const LineFitSums& sums){
+	if(sums.maxX - sums.minX > sums.maxY - sums.minY){
+		double a = (sums.n * sums.sxy - sums.sx * sums.sy) / (sums.n * sums.sxx - sums.sx * sums.sx);
+		double b = (sums.sy - a * sums.sx) / sums.n;
+		return Point3f((float)a, -1., (float)b);
 	}
 	else{
-		for(unsigned int i =0; i < nContours.size(); i++){
-			A.at<float>(i,0)= nContours[i].y;
-			B.at<float>(i,0)= nContours[i].x;
-		}
-
-		solve(A, B, C, DECOMP_NORMAL);
-
-		return Point3f(-1., C.at<float>(0, 0), C.at<float>(1, 0));
+		double a = (sums.n * sums.sxy - sums.sy * sums.sx) / (sums.n * sums.syy - sums.sy * sums.sy);
+		double b = (sums.sx - a * sums.sy) / sums.n;
+		return Point3f(-1., (float)a, (float)b);
 	}
-
 }
 
 /**
@@ -852,41 +1502,53 @@ static void _distortPoints(vector<cv::Point2f>& in, const Mat& camMatrix, const
 
 /**
  * Refine Corners using the contour vector :: Called from function detectMarkers
- * @param nContours, contour-container
+ * @param nContours, contour-container (image pixels, used to locate the corners)
+ * @param xs, x coordinates of the contour points, undistorted if the camera is known
+ * @param ys, y coordinates of the contour points, undistorted if the camera is known
  * @param nCorners, candidate Corners
- * @param camMatrix, cameraMatrix input 3x3 floating-point camera matrix
- * @param distCoeff, distCoeffs vector of distortion coefficient
+ * @return false if the corners were kept as they are (in image pixels, not undistorted)
  */
-static void _refineCandidateLines(std::vector<Point>& nContours, std::vector<Point2f>& nCorners, const Mat& camMatrix, const Mat& distCoeff){
-	vector<Point2f> contour2f(nContours.begin(), nContours.end());
-
-	if(!camMatrix.empty() && !distCoeff.empty()){
-		undistortPoints(contour2f, contour2f, camMatrix, distCoeff);
-	}
-
-	/* 5 groups :: to group the edges
-	 * 4 - classified by its corner
-	 * extra group - (temporary) if contours do not begin with a corner
-	 */
-	vector<Point2f> cntPts[5];
-	int cornerIndex[4]={-1};
-	int group=4;
-
-	for ( unsigned int i =0; i < nContours.size(); i++ ) {
+static bool _refineCandidateLines(const std::vector<Point>& nContours, const float* xs, const float* ys, std::vector<Point2f>& nCorners){
+	int nPoints = (int)nContours.size();
+	int cornerIndex[4]={-1, -1, -1, -1};
+
+	// each corner starts at its closest contour point (the same point for findContours
+	// candidates, the nearest pixel for subpixel corners of the line segment engine)
+	float cornerDistance[4] = {FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX};
+	for ( int i =0; i < nPoints; i++ ) {
 		for(unsigned int j=0; j<4; j++){
-			if ( nCorners[j] == contour2f[i] ){
+			Point2f diff = nCorners[j] - Point2f(nContours[i]);
+			float distance = diff.dot(diff);
+			if ( distance < cornerDistance[j] ){
+				cornerDistance[j] = distance;
 				cornerIndex[j] = i;
-				group=j;
 			}
 		}
-		cntPts[group].push_back(contour2f[i]);
 	}
 
-	// saves extra group into corresponding
-	if( !cntPts[4].empty() ){
-		for( unsigned int i=0; i < cntPts[4].size() ; i++ )
-			cntPts[group].push_back(cntPts[4].at(i));
-		cntPts[4].clear();
+	/* 4 sides :: each side runs from its corner to the next corner along the contour,
+	 * the side of the last corner wraps around the start of the contour
+	 */
+	int sortedCorners[4] = {0, 1, 2, 3};
+	std::sort(sortedCorners, sortedCorners + 4,
+	          [&cornerIndex](int a, int b) { return cornerIndex[a] < cornerIndex[b]; });
+
+	LineFitSums sums[4];
+	for(int k=0; k<4; k++){
+		int j = sortedCorners[k];
+		LineFitSums& side = sums[j];
+		side.n = side.sx = side.sy = side.sxx = side.sxy = side.syy = 0;
+		side.minX = side.minY = FLT_MAX;
+		side.maxX = side.maxY = -FLT_MAX;
+		if(k < 3){
+			_accumulateLineSums(xs, ys, cornerIndex[j], cornerIndex[sortedCorners[k + 1]], side);
+		}
+		else{
+			_accumulateLineSums(xs, ys, cornerIndex[j], nPoints, side);
+			_accumulateLineSums(xs, ys, 0, cornerIndex[sortedCorners[0]], side);
+		}
+		// two corners on the same contour point, keep the corners as they are
+		if(side.n < 2) return false;
 	}
 
 	//Evaluate contour direction :: using the position of the detected corners
@@ -898,7 +1560,7 @@ static void _refineCandidateLines(std::vector<Point>& nContours, std::vector<Poi
 	// calculate the line :: who passes through the grouped points
 	Point3f lines[4];
 	for(int i=0; i<4; i++){
-		lines[i]=_interpolate2Dline(cntPts[i]);
+		lines[i]=_interpolate2Dline(sums[i]);
 	}
 
 	/*
@@ -916,10 +1578,7 @@ static void _refineCandidateLines(std::vector<Point>& nContours, std::vector<Poi
 		else
 			nCorners[i] = _getCrossPoint(lines[ i ], lines[ (i+3)%4 ]);	// 30 01 12 23
 	}
-
-	if(!camMatrix.empty() && !distCoeff.empty()){
-		_distortPoints(nCorners, camMatrix, distCoeff);
-	}
+	return true;
 }
 
 
@@ -929,13 +1588,13 @@ static void _refineCandidateLines(std::vector<Point>& nContours, std::vector<Poi
   */
 class MarkerContourParallel : public ParallelLoopBody {
     public:
-    MarkerContourParallel( vector< vector< Point > >& _contours, vector< vector< Point2f > >& _candidates,  const Mat& _camMatrix, const Mat& _distCoeff)
-        : contours(_contours), candidates(_candidates), camMatrix(_camMatrix), distCoeff(_distCoeff){}
+    MarkerContourParallel( vector< vector< Point > >& _contours, vector< int >& _offsets, vector< float >& _xs, vector< float >& _ys, vector< vector< Point2f > >& _candidates, vector< uchar >& _refined)
+        : contours(_contours), offsets(_offsets), xs(_xs), ys(_ys), candidates(_candidates), refined(_refined){}
 
     void operator()(const Range &range) const {
 
         for(int i = range.start; i < range.end; i++) {
-            _refineCandidateLines(contours[i], candidates[i], camMatrix, distCoeff);
+            refined[i] = _refineCandidateLines(contours[i], &xs[offsets[i]], &ys[offsets[i]], candidates[i]);
         }
     }
 
@@ -945,18 +1604,77 @@ class MarkerContourParallel : public ParallelLoopBody {
     }
 
     vector< vector< Point > >& contours;
+    vector< int >& offsets;
+    vector< float >& xs;
+    vector< float >& ys;
     vector< vector< Point2f > >& candidates;
-    const Mat& camMatrix;
-    const Mat& distCoeff;
+    vector< uchar >& refined;
 };
 
 
+/**
+ * Refine the corners of all the markers using their contours :: Called from function detectMarkers
+ * The contour points of all the markers are kept in flat coordinate arrays and undistorted with a
+ * single call, the refined corners are distorted back with a single call too.
+ * @param contours, contour-container of each marker
+ * @param candidates, corners of each marker
+ * @param camMatrix, cameraMatrix input 3x3 floating-point camera matrix
+ * @param distCoeff, distCoeffs vector of distortion coefficient
+ */
+static void _refineCandidatesLines(vector< vector< Point > >& contours, vector< vector< Point2f > >& candidates,
+                                   const Mat& camMatrix, const Mat& distCoeff){
+    int nMarkers = (int)candidates.size();
+    bool useCamera = !camMatrix.empty() && !distCoeff.empty();
+
+    vector< int > offsets(nMarkers + 1, 0);
+    for(int i = 0; i < nMarkers; i++)
+        offsets[i + 1] = offsets[i] + (int)contours[i].size();
+
+    vector< Point2f > points;
+    points.reserve(offsets[nMarkers]);
+    for(int i = 0; i < nMarkers; i++)
+        points.insert(points.end(), contours[i].begin(), contours[i].end());
+
+    // undistorted points stay in pixel units, as _distortPoints expects
+    if(useCamera)
+        undistortPoints(points, points, camMatrix, distCoeff, noArray(), camMatrix);
+
+    vector< float > xs(points.size()), ys(points.size());
+    for(unsigned int i = 0; i < points.size(); i++) {
+        xs[i] = points[i].x;
+        ys[i] = points[i].y;
+    }
+
+    vector< uchar > refined(nMarkers, 0);
+    parallel_for_(Range(0, nMarkers), MarkerContourParallel(contours, offsets, xs, ys, candidates, refined));
+
+    // only the refined corners are undistorted, the kept ones are still in image pixels
+    if(useCamera) {
+        vector< Point2f > corners;
+        corners.reserve(4 * nMarkers);
+        for(int i = 0; i < nMarkers; i++)
+            if(refined[i])
+                corners.insert(corners.end(), candidates[i].begin(), candidates[i].end());
+        if(!corners.empty())
+            _distortPoints(corners, camMatrix, distCoeff);
+        vector< Point2f >::const_iterator distorted = corners.begin();
+        for(int i = 0; i < nMarkers; i++) {
+            if(!refined[i])
+                continue;
+            std::copy(distorted, distorted + 4, candidates[i].begin());
+            distorted += 4;
+        }
+    }
+}
+
+
 
 /**
   */
 void detectMarkers(InputArray _image, const Ptr<Dictionary> &_dictionary, OutputArrayOfArrays _corners,
                    OutputArray _ids, const Ptr<DetectorParameters> &_params,
-                   OutputArrayOfArrays _rejectedImgPoints, InputArrayOfArrays camMatrix, InputArrayOfArrays distCoeff) {
+                   OutputArrayOfArrays _rejectedImgPoints, InputArrayOfArrays camMatrix, InputArrayOfArrays distCoeff,
+                   OutputArray _confidences) {
 
     CV_Assert(!_image.empty());
 
@@ -967,36 +1685,35 @@ void detectMarkers(InputArray _image, const Ptr<Dictionary> &_dictionary, Output
     vector< vector< Point2f > > candidates;
     vector< vector< Point > > contours;
     vector< int > ids;
+    vector< Vec3i > confidences;
     _detectCandidates(grey, candidates, contours, _params);
 
     /// STEP 2: Check candidate codification (identify markers)
-    _identifyCandidates(grey, candidates, contours, _dictionary, candidates, ids, _params,
-                        _rejectedImgPoints);
+    _identifyCandidates(grey, candidates, contours, _dictionary, candidates, ids, confidences,
+                        _params, _rejectedImgPoints);
 
     /// STEP 3: Filter detected markers;
-    _filterDetectedMarkers(candidates, ids, contours);
+    _filterDetectedMarkers(candidates, ids, confidences, contours);
 
     // copy to output arrays
     _copyVector2Output(candidates, _corners);
     Mat(ids).copyTo(_ids);
+    if(_confidences.needed()) {
+        Mat(confidences).copyTo(_confidences);
+    }
 
     /// STEP 4: Corner refinement :: use corner subpix
     if( _params->cornerRefinementMethod == CORNER_REFINE_SUBPIX ) {
         CV_Assert(_params->cornerRefinementWinSize > 0 && _params->cornerRefinementMaxIterations > 0 &&
                   _params->cornerRefinementMinAccuracy > 0);
 
-        //// do corner refinement for each of the detected markers
-        // for (unsigned int i = 0; i < _corners.cols(); i++) {
-        //    cornerSubPix(grey, _corners.getMat(i),
-        //                 Size(params.cornerRefinementWinSize, params.cornerRefinementWinSize),
-        //                 Size(-1, -1), TermCriteria(TermCriteria::MAX_ITER | TermCriteria::EPS,
-        //                                            params.cornerRefinementMaxIterations,
-        //                                            params.cornerRefinementMinAccuracy));
-        //}
+        // all the corners of all the markers in one pass, sharing the window weights
+        CornerSubpixelWindow window(_params->cornerRefinementWinSize);
+        parallel_for_(Range(0, 4 * (int)candidates.size()),
+                      MarkerSubpixelParallel(&grey, candidates, window, _params));
 
-        // this is the parallel call for the previous commented loop (result is equivalent)
-        parallel_for_(Range(0, _corners.cols()),
-                      MarkerSubpixelParallel(&grey, _corners, _params));
+        // copy the corners to the output array
+        _copyVector2Output(candidates, _corners);
     }
 
     /// STEP 4, Optional : Corner refinement :: use contour container
@@ -1005,7 +1722,7 @@ void detectMarkers(InputArray _image, const Ptr<Dictionary> &_dictionary, Output
         if(! _ids.empty()){
 
             // do corner refinement using the contours for each detected markers
-            parallel_for_(Range(0, _corners.cols()), MarkerContourParallel(contours, candidates, camMatrix.getMat(), distCoeff.getMat()));
+            _refineCandidatesLines(contours, candidates, camMatrix.getMat(), distCoeff.getMat());
 
             // copy the corners to the output array
             _copyVector2Output(candidates, _corners);
@@ -1015,6 +1732,255 @@ void detectMarkers(InputArray _image, const Ptr<Dictionary> &_dictionary, Output
 
 
 
+/**
+  * ParallelLoopBody class for the candidate search of several frames, one task per frame and
+  * threshold window size (one task per frame for the line segment engine)
+  * Called from function detectMarkersBatch()
+  */
+class BatchCandidatesParallel : public ParallelLoopBody {
+    public:
+    BatchCandidatesParallel(const vector< Mat > &_searchImages, int _nScales,
+                            vector< vector< vector< Point2f > > > &_candidatesArrays,
+                            vector< vector< vector< Point > > > &_contoursArrays,
+                            const Ptr<DetectorParameters> &_params)
+        : searchImages(_searchImages), nScales(_nScales), candidatesArrays(_candidatesArrays),
+          contoursArrays(_contoursArrays), params(_params) {}
+
+    void operator()(const Range &range) const {
+        for(int i = range.start; i < range.end; i++) {
+            const Mat &searchImage = searchImages[i / nScales];
+            if(params->candidateEngine == CANDIDATE_ENGINE_LINE_SEGMENTS) {
+                _detectLineSegmentCandidates(searchImage, candidatesArrays[i], contoursArrays[i],
+                                             params);
+                continue;
+            }
+
+            int currScale =
+                params->adaptiveThreshWinSizeMin + (i % nScales) * params->adaptiveThreshWinSizeStep;
+            Mat thresh;
+            _threshold(searchImage, thresh, currScale, params->adaptiveThreshConstant);
+            _findMarkerContours(thresh, candidatesArrays[i], contoursArrays[i],
+                                params->minMarkerPerimeterRate, params->maxMarkerPerimeterRate,
+                                params->polygonalApproxAccuracyRate, params->minCornerDistanceRate,
+                                params->minDistanceToBorder);
+        }
+    }
+
+    private:
+    BatchCandidatesParallel &operator=(const BatchCandidatesParallel &); // to quiet MSVC
+
+    const vector< Mat > &searchImages;
+    int nScales;
+    vector< vector< vector< Point2f > > > &candidatesArrays;
+    vector< vector< vector< Point > > > &contoursArrays;
+    const Ptr<DetectorParameters> &params;
+};
+
+
+/**
+  * ParallelLoopBody class for the identification of the candidates of several frames, one task
+  * per candidate of all the frames
+  * Called from function detectMarkersBatch()
+  */
+class BatchIdentifyParallel : public ParallelLoopBody {
+    public:
+    BatchIdentifyParallel(const vector< Mat > &_greys, vector< Vec2i > &_tasks,
+                          vector< vector< vector< Point2f > > > &_candidates,
+                          const Ptr<Dictionary> &_dictionary, vector< int > &_idsTmp,
+                          vector< Vec3i > &_confidencesTmp, vector< char > &_validCandidates,
+                          const Ptr<DetectorParameters> &_params)
+        : greys(_greys), tasks(_tasks), candidates(_candidates), dictionary(_dictionary),
+          idsTmp(_idsTmp), confidencesTmp(_confidencesTmp), validCandidates(_validCandidates),
+          params(_params) {}
+
+    void operator()(const Range &range) const {
+        for(int i = range.start; i < range.end; i++) {
+            int frame = tasks[i][0], candidate = tasks[i][1];
+            int currId;
+            if(_identifyOneCandidate(dictionary, greys[frame], candidates[frame][candidate], currId,
+                                     confidencesTmp[i], params)) {
+                validCandidates[i] = 1;
+                idsTmp[i] = currId;
+            }
+        }
+    }
+
+    private:
+    BatchIdentifyParallel &operator=(const BatchIdentifyParallel &); // to quiet MSVC
+
+    const vector< Mat > &greys;
+    vector< Vec2i > &tasks;
+    vector< vector< vector< Point2f > > > &candidates;
+    const Ptr<Dictionary> &dictionary;
+    vector< int > &idsTmp;
+    vector< Vec3i > &confidencesTmp;
+    vector< char > &validCandidates;
+    const Ptr<DetectorParameters> &params;
+};
+
+
+/**
+  * ParallelLoopBody class for the subpixel refinement of the markers of several frames, one task
+  * per corner of all the markers of all the frames
+  * Called from function detectMarkersBatch()
+  */
+class BatchSubpixelParallel : public ParallelLoopBody {
+    public:
+    BatchSubpixelParallel(const vector< Mat > &_greys, vector< Vec2i > &_tasks,
+                          vector< vector< vector< Point2f > > > &_corners,
+                          const CornerSubpixelWindow &_window, const Ptr<DetectorParameters> &_params)
+        : greys(_greys), tasks(_tasks), corners(_corners), window(_window), params(_params) {}
+
+    void operator()(const Range &range) const {
+        int sampledSize = window.size + 2;
+        AutoBuffer< float > buffer((size_t)(sampledSize * sampledSize + 2 * window.size * window.size));
+
+        for(int i = range.start; i < range.end; i++) {
+            int frame = tasks[i / 4][0], marker = tasks[i / 4][1];
+            _refineCornerSubpix(greys[frame], corners[frame][marker][i % 4], window,
+                                params->cornerRefinementMaxIterations,
+                                params->cornerRefinementMinAccuracy, buffer);
+        }
+    }
+
+    private:
+    BatchSubpixelParallel &operator=(const BatchSubpixelParallel &); // to quiet MSVC
+
+    const vector< Mat > &greys;
+    vector< Vec2i > &tasks;
+    vector< vector< vector< Point2f > > > &corners;
+    const CornerSubpixelWindow &window;
+    const Ptr<DetectorParameters> &params;
+};
+
+
+
+/**
+  */
+void detectMarkersBatch(InputArrayOfArrays _images, const Ptr<Dictionary> &_dictionary,
+                        vector< vector< vector< Point2f > > > &_corners,
+                        vector< vector< int > > &_ids, const Ptr<DetectorParameters> &_params,
+                        InputArray camMatrix, InputArray distCoeff) {
+
+    int nFrames = (int)_images.total();
+    _corners.assign((size_t)nFrames, vector< vector< Point2f > >());
+    _ids.assign((size_t)nFrames, vector< int >());
+
+    // every stage is one flat parallel_for_ over the tasks of all the frames, parallel_for_ calls
+    // nested inside a parallel region would run serially
+    vector< Mat > greys((size_t)nFrames), searchImages((size_t)nFrames);
+    for(int f = 0; f < nFrames; f++) {
+        Mat image = _images.getMat(f);
+        CV_Assert(!image.empty());
+        _convertToGrey(image, greys[f]);
+        searchImages[f] = _getSearchImage(greys[f], _params);
+    }
+
+    /// STEP 1: Detect marker candidates, one task per frame and threshold window size
+    int nScales = 1;
+    if(_params->candidateEngine != CANDIDATE_ENGINE_LINE_SEGMENTS)
+        nScales = _getThresholdScales(_params);
+    vector< vector< vector< Point2f > > > candidatesArrays((size_t)(nFrames * nScales));
+    vector< vector< vector< Point > > > contoursArrays((size_t)(nFrames * nScales));
+    parallel_for_(Range(0, nFrames * nScales),
+                  BatchCandidatesParallel(searchImages, nScales, candidatesArrays, contoursArrays,
+                                          _params));
+
+    vector< vector< vector< Point2f > > > candidates((size_t)nFrames);
+    vector< vector< vector< Point > > > contours((size_t)nFrames);
+    vector< Vec2i > tasks;
+    for(int f = 0; f < nFrames; f++) {
+        vector< vector< Point2f > > frameCandidates;
+        vector< vector< Point > > frameContours;
+        for(int i = f * nScales; i < (f + 1) * nScales; i++) {
+            frameCandidates.insert(frameCandidates.end(), candidatesArrays[i].begin(),
+                                   candidatesArrays[i].end());
+            frameContours.insert(frameContours.end(), contoursArrays[i].begin(),
+                                 contoursArrays[i].end());
+        }
+        _finishCandidates(frameCandidates, frameContours, candidates[f], contours[f], _params);
+        for(int c = 0; c < (int)candidates[f].size(); c++)
+            tasks.push_back(Vec2i(f, c));
+    }
+
+    /// STEP 2: Check candidate codification, one task per candidate of all the frames
+    int nTasks = (int)tasks.size();
+    vector< int > idsTmp(nTasks, -1);
+    vector< Vec3i > confidencesTmp(nTasks);
+    vector< char > validCandidates(nTasks, 0);
+    parallel_for_(Range(0, nTasks),
+                  BatchIdentifyParallel(greys, tasks, candidates, _dictionary, idsTmp,
+                                        confidencesTmp, validCandidates, _params));
+
+    /// STEP 3: Filter detected markers
+    vector< vector< vector< Point > > > markerContours((size_t)nFrames);
+    vector< vector< Vec3i > > confidences((size_t)nFrames);
+    for(int i = 0; i < nTasks; i++) {
+        if(!validCandidates[i]) continue;
+        int f = tasks[i][0], c = tasks[i][1];
+        _corners[f].push_back(candidates[f][c]);
+        _ids[f].push_back(idsTmp[i]);
+        confidences[f].push_back(confidencesTmp[i]);
+        markerContours[f].push_back(contours[f][c]);
+    }
+    tasks.clear();
+    for(int f = 0; f < nFrames; f++) {
+        _filterDetectedMarkers(_corners[f], _ids[f], confidences[f], markerContours[f]);
+        for(int m = 0; m < (int)_corners[f].size(); m++)
+            tasks.push_back(Vec2i(f, m));
+    }
+
+    /// STEP 4: Corner refinement, subpixel with one task per corner of all the frames
+    if(_params->cornerRefinementMethod == CORNER_REFINE_SUBPIX) {
+        CV_Assert(_params->cornerRefinementWinSize > 0 && _params->cornerRefinementMaxIterations > 0 &&
+                  _params->cornerRefinementMinAccuracy > 0);
+
+        CornerSubpixelWindow window(_params->cornerRefinementWinSize);
+        parallel_for_(Range(0, 4 * (int)tasks.size()),
+                      BatchSubpixelParallel(greys, tasks, _corners, window, _params));
+    }
+
+    // the contour refinement undistorts the contours of a frame in one call and runs its own
+    // parallel_for_ over the markers of the frame
+    if(_params->cornerRefinementMethod == CORNER_REFINE_CONTOUR) {
+        for(int f = 0; f < nFrames; f++) {
+            if(!_ids[f].empty())
+                _refineCandidatesLines(markerContours[f], _corners[f], camMatrix.getMat(),
+                                       distCoeff.getMat());
+        }
+    }
+}
+
+
+
+/**
+  */
+void extractMarkerBits(InputArray _image, InputArray _corners, const Ptr<Dictionary> &_dictionary,
+                       OutputArray _bits, const Ptr<DetectorParameters> &_params) {
+
+    CV_Assert(!_image.empty());
+    CV_Assert(_corners.total() == 4);
+
+    Mat grey;
+    _convertToGrey(_image.getMat(), grey);
+
+    Mat corners;
+    _corners.getMat().convertTo(corners, CV_32F);
+    corners = corners.reshape(2, 4);
+
+    Mat bits = _extractBits(grey, corners, _dictionary->markerSize, _params->markerBorderBits,
+                            _params->perspectiveRemovePixelPerCell,
+                            _params->perspectiveRemoveIgnoredMarginPerCell,
+                            _params->minOtsuStdDev);
+
+    // remove the border, the rest has the layout of Dictionary::bytesList codes
+    bits.rowRange(_params->markerBorderBits, bits.rows - _params->markerBorderBits)
+        .colRange(_params->markerBorderBits, bits.cols - _params->markerBorderBits)
+        .copyTo(_bits);
+}
+
+
+
 /**
   * ParallelLoopBody class for the parallelization of the single markers pose estimation
   * Called from function estimatePoseSingleMarkers()
@@ -1229,6 +2195,71 @@ static void _projectUndetectedMarkers(const Ptr<Board> &_board, InputOutputArray
 
 
 
+/**
+  * Uniform grid over the centroids of candidates given as 4 consecutive corners. Candidates are
+  * bucketed by cell with a counting sort, so a radius query only visits the cells it overlaps.
+  * Cell coordinates are clamped to the image, which keeps queries from outside the image exact.
+  */
+struct CandidateCentroidGrid {
+    int cols, rows;
+    float cellSize;
+    vector< int > cellStart, cellItems;
+
+    CandidateCentroidGrid(const vector< Point2f > &candidatesCorners, Size imageSize,
+                          float _cellSize)
+        : cellSize(_cellSize) {
+        CV_Assert(cellSize > 0);
+        cols = max(1, cvCeil(imageSize.width / cellSize));
+        rows = max(1, cvCeil(imageSize.height / cellSize));
+
+        int nCandidates = (int)candidatesCorners.size() / 4;
+        vector< int > candidateCell((size_t)nCandidates);
+        cellStart.assign((size_t)cols * rows + 1, 0);
+        for(int i = 0; i < nCandidates; i++) {
+            Point2f centroid = (candidatesCorners[4 * i] + candidatesCorners[4 * i + 1] +
+                                candidatesCorners[4 * i + 2] + candidatesCorners[4 * i + 3]) *
+                               0.25f;
+            candidateCell[i] = _cellY(centroid.y) * cols + _cellX(centroid.x);
+            cellStart[candidateCell[i] + 1]++;
+        }
+        for(int c = 0; c < cols * rows; c++)
+            cellStart[c + 1] += cellStart[c];
+
+        // candidates stay in ascending order inside each cell
+        vector< int > fill(cellStart.begin(), cellStart.end() - 1);
+        cellItems.resize((size_t)nCandidates);
+        for(int i = 0; i < nCandidates; i++)
+            cellItems[fill[candidateCell[i]]++] = i;
+    }
+
+    /** @brief candidates whose centroid may be within radius of center, in ascending order */
+    void query(Point2f center, float radius, vector< int > &candidates) const {
+        candidates.clear();
+        int x0 = _cellX(center.x - radius), x1 = _cellX(center.x + radius);
+        int y0 = _cellY(center.y - radius), y1 = _cellY(center.y + radius);
+        for(int y = y0; y <= y1; y++) {
+            for(int x = x0; x <= x1; x++) {
+                int cell = y * cols + x;
+                candidates.insert(candidates.end(), cellItems.begin() + cellStart[cell],
+                                  cellItems.begin() + cellStart[cell + 1]);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+    }
+
+    int _cellX(float x) const {
+        // clamp before the conversion, far projections may not fit in an int
+        return cvFloor(min(max(x / cellSize, 0.f), float(cols - 1)));
+    }
+
+    int _cellY(float y) const {
+        // clamp before the conversion, far projections may not fit in an int
+        return cvFloor(min(max(y / cellSize, 0.f), float(rows - 1)));
+    }
+};
+
+
+
 /**
   */
 void refineDetectedMarkers(InputArray _image, const Ptr<Board> &_board,
@@ -1261,6 +2292,15 @@ void refineDetectedMarkers(InputArray _image, const Ptr<Board> &_board,
     // list of missing markers indicating if they have been assigned to a candidate
     vector< bool > alreadyIdentified(_rejectedCorners.total(), false);
 
+    // copy the rejected corners once, they are compared against every projected marker
+    unsigned int nRejected = (unsigned int)_rejectedCorners.total();
+    vector< Point2f > rejectedCorners(4 * nRejected);
+    for(unsigned int j = 0; j < nRejected; j++) {
+        Mat rejected = _rejectedCorners.getMat(j);
+        for(int c = 0; c < 4; c++)
+            rejectedCorners[4 * j + c] = rejected.ptr< Point2f >()[c];
+    }
+
     // maximum bits that can be corrected
     Dictionary &dictionary = *(_board->dictionary);
     int maxCorrectionRecalculated =
@@ -1269,6 +2309,15 @@ void refineDetectedMarkers(InputArray _image, const Ptr<Board> &_board,
     Mat grey;
     _convertToGrey(_image, grey);
 
+    // a candidate is only accepted if all its corners are closer than the search radius to the
+    // projected ones, so its centroid is closer than the radius to the projected centroid too
+    float searchRadius = sqrt(minRepDistance * minRepDistance + 1.f);
+    CandidateCentroidGrid grid(rejectedCorners, grey.size(), searchRadius);
+    vector< int > neighbours;
+
+    // byte lists of the candidates in the 4 rotations, extracted at most once per candidate
+    vector< Mat > candidatesBytes(nRejected);
+
     // vector of final detected marker corners and ids
     vector< Mat > finalAcceptedCorners;
     vector< int > finalAcceptedIds;
@@ -1287,10 +2336,17 @@ void refineDetectedMarkers(InputArray _image, const Ptr<Board> &_board,
         // best match at the moment
         int closestCandidateIdx = -1;
         double closestCandidateDistance = minRepDistance * minRepDistance + 1;
-        Mat closestRotatedMarker;
+        int closestCandidateRot = 0;
+
+        Point2f projectedCentroid = (undetectedMarkersCorners[i][0] + undetectedMarkersCorners[i][1] +
+                                     undetectedMarkersCorners[i][2] + undetectedMarkersCorners[i][3]) *
+                                    0.25f;
+        grid.query(projectedCentroid, searchRadius, neighbours);
 
-        for(unsigned int j = 0; j < _rejectedCorners.total(); j++) {
+        for(unsigned int n = 0; n < neighbours.size(); n++) {
+            int j = neighbours[n];
             if(alreadyIdentified[j]) continue;
+            const Point2f *rejCorners = &rejectedCorners[4 * j];
 
             // check distance
             double minDistance = closestCandidateDistance + 1;
@@ -1299,8 +2355,7 @@ void refineDetectedMarkers(InputArray _image, const Ptr<Board> &_board,
             for(int c = 0; c < 4; c++) { // first corner in rejected candidate
                 double currentMaxDistance = 0;
                 for(int k = 0; k < 4; k++) {
-                    Point2f rejCorner = _rejectedCorners.getMat(j).ptr< Point2f >()[(c + k) % 4];
-                    Point2f distVector = undetectedMarkersCorners[i][k] - rejCorner;
+                    Point2f distVector = undetectedMarkersCorners[i][k] - rejCorners[(c + k) % 4];
                     double cornerDist = distVector.x * distVector.x + distVector.y * distVector.y;
                     currentMaxDistance = max(currentMaxDistance, cornerDist);
                 }
@@ -1315,56 +2370,61 @@ void refineDetectedMarkers(InputArray _image, const Ptr<Board> &_board,
 
             if(!valid) continue;
 
-            // apply rotation
-            Mat rotatedMarker;
-            if(checkAllOrders) {
-                rotatedMarker = Mat(4, 1, CV_32FC2);
-                for(int c = 0; c < 4; c++)
-                    rotatedMarker.ptr< Point2f >()[c] =
-                        _rejectedCorners.getMat(j).ptr< Point2f >()[(c + 4 + validRot) % 4];
-            }
-            else rotatedMarker = _rejectedCorners.getMat(j);
-
             // last filter, check if inner code is close enough to the assigned marker code
             int codeDistance = 0;
             // if errorCorrectionRate, dont check code
             if(errorCorrectionRate >= 0) {
 
-                // extract bits
-                Mat bits = _extractBits(
-                    grey, rotatedMarker, dictionary.markerSize, params.markerBorderBits,
-                    params.perspectiveRemovePixelPerCell,
-                    params.perspectiveRemoveIgnoredMarginPerCell, params.minOtsuStdDev);
+                // extract bits in the original corner order, the byte list already holds the
+                // other orders as rotations
+                if(candidatesBytes[j].empty()) {
+                    Mat bits = _extractBits(
+                        grey, Mat(4, 1, CV_32FC2, (void *)rejCorners), dictionary.markerSize,
+                        params.markerBorderBits, params.perspectiveRemovePixelPerCell,
+                        params.perspectiveRemoveIgnoredMarginPerCell, params.minOtsuStdDev);
+
+                    Mat onlyBits =
+                        bits.rowRange(params.markerBorderBits, bits.rows - params.markerBorderBits)
+                            .colRange(params.markerBorderBits, bits.rows - params.markerBorderBits);
 
-                Mat onlyBits =
-                    bits.rowRange(params.markerBorderBits, bits.rows - params.markerBorderBits)
-                        .colRange(params.markerBorderBits, bits.rows - params.markerBorderBits);
+                    candidatesBytes[j] = Dictionary::getByteListFromBits(onlyBits);
+                }
 
-                codeDistance =
-                    dictionary.getDistanceToId(onlyBits, undetectedMarkersIds[i], false);
+                int nbytes = candidatesBytes[j].cols;
+                codeDistance = cv::hal::normHamming(dictionary.bytesList.ptr(undetectedMarkersIds[i]),
+                                                    candidatesBytes[j].ptr() + validRot * nbytes,
+                                                    nbytes);
             }
 
             // if everythin is ok, assign values to current best match
             if(errorCorrectionRate < 0 || codeDistance < maxCorrectionRecalculated) {
                 closestCandidateIdx = j;
                 closestCandidateDistance = minDistance;
-                closestRotatedMarker = rotatedMarker;
+                closestCandidateRot = validRot;
             }
         }
 
         // if at least one good match, we have rescue the missing marker
         if(closestCandidateIdx >= 0) {
 
+            // apply rotation
+            Mat closestRotatedMarker(4, 1, CV_32FC2);
+            for(int c = 0; c < 4; c++)
+                closestRotatedMarker.ptr< Point2f >()[c] =
+                    rejectedCorners[4 * closestCandidateIdx + (c + closestCandidateRot) % 4];
+
             // subpixel refinement
             if(_params->cornerRefinementMethod == CORNER_REFINE_SUBPIX) {
                 CV_Assert(params.cornerRefinementWinSize > 0 &&
                           params.cornerRefinementMaxIterations > 0 &&
                           params.cornerRefinementMinAccuracy > 0);
-                cornerSubPix(grey, closestRotatedMarker,
-                             Size(params.cornerRefinementWinSize, params.cornerRefinementWinSize),
-                             Size(-1, -1), TermCriteria(TermCriteria::MAX_ITER | TermCriteria::EPS,
-                                                        params.cornerRefinementMaxIterations,
-                                                        params.cornerRefinementMinAccuracy));
+                CornerSubpixelWindow window(params.cornerRefinementWinSize);
+                AutoBuffer< float > buffer((size_t)((window.size + 2) * (window.size + 2) +
+                                                    2 * window.size * window.size));
+                for(int c = 0; c < 4; c++)
+                    _refineCornerSubpix(grey, closestRotatedMarker.ptr< Point2f >()[c], window,
+                                        params.cornerRefinementMaxIterations,
+                                        params.cornerRefinementMinAccuracy, buffer);
             }
 
             // remove from rejected
@@ -1449,6 +2509,171 @@ int estimatePoseBoard(InputArrayOfArrays _corners, InputArray _ids, const Ptr<Bo
 
 
 
+/**
+  * Project the board markers with the given pose and mark as inliers the markers whose four
+  * corners are all closer than threshold to the detected ones. Returns the number of inliers and
+  * the sum of the squared corner errors of the inliers
+  */
+static int _scoreBoardPose(const vector< Point3f > &objPoints, const vector< Point2f > &imgPoints,
+                           InputArray _cameraMatrix, InputArray _distCoeffs, const Mat &rvec,
+                           const Mat &tvec, float threshold, vector< uchar > &markerInliers,
+                           double &inliersError) {
+
+    vector< Point2f > projected;
+    projectPoints(objPoints, rvec, tvec, _cameraMatrix, _distCoeffs, projected);
+
+    int nMarkers = (int)objPoints.size() / 4;
+    double squaredThreshold = double(threshold) * threshold;
+    markerInliers.assign((size_t)nMarkers, 0);
+    inliersError = 0;
+    int nInliers = 0;
+    for(int m = 0; m < nMarkers; m++) {
+        double markerError = 0, maxCornerError = 0;
+        for(int c = 0; c < 4; c++) {
+            Point2f distVector = projected[4 * m + c] - imgPoints[4 * m + c];
+            double cornerError = distVector.x * distVector.x + distVector.y * distVector.y;
+            markerError += cornerError;
+            maxCornerError = max(maxCornerError, cornerError);
+        }
+        if(maxCornerError <= squaredThreshold) {
+            markerInliers[m] = 1;
+            inliersError += markerError;
+            nInliers++;
+        }
+    }
+    return nInliers;
+}
+
+
+
+/**
+  */
+int estimatePoseBoardRobust(InputArrayOfArrays _corners, InputArray _ids, const Ptr<Board> &board,
+                            InputArray _cameraMatrix, InputArray _distCoeffs,
+                            InputOutputArray _rvec, InputOutputArray _tvec, bool useExtrinsicGuess,
+                            OutputArray _inliers, double *residual, float reprojectionThreshold,
+                            int iterationsCount) {
+
+    CV_Assert(_corners.total() == _ids.total());
+    CV_Assert(reprojectionThreshold > 0 && iterationsCount > 0);
+
+    // object and image points of the markers in the board, four per marker, and the index of
+    // each of those markers in the input
+    vector< Point3f > objPoints;
+    vector< Point2f > imgPoints;
+    vector< int > markerIdxs;
+    for(unsigned int i = 0; i < _ids.total(); i++) {
+        int currentId = _ids.getMat().ptr< int >(0)[i];
+        for(unsigned int j = 0; j < board->ids.size(); j++) {
+            if(currentId == board->ids[j]) {
+                for(int p = 0; p < 4; p++) {
+                    objPoints.push_back(board->objPoints[j][p]);
+                    imgPoints.push_back(_corners.getMat(i).ptr< Point2f >(0)[p]);
+                }
+                markerIdxs.push_back(i);
+                break;
+            }
+        }
+    }
+    int nMarkers = (int)markerIdxs.size();
+
+    // best pose at the moment
+    int bestCount = 0;
+    double bestError = 0;
+    vector< uchar > bestInliers, markerInliers;
+    Mat bestRvec, bestTvec;
+
+    // the pose of the previous frame is the first hypothesis
+    if(nMarkers > 0 && useExtrinsicGuess && _rvec.total() == 3 && _tvec.total() == 3) {
+        _rvec.getMat().reshape(1, 3).convertTo(bestRvec, CV_64F);
+        _tvec.getMat().reshape(1, 3).convertTo(bestTvec, CV_64F);
+        bestCount = _scoreBoardPose(objPoints, imgPoints, _cameraMatrix, _distCoeffs, bestRvec,
+                                    bestTvec, reprojectionThreshold, bestInliers, bestError);
+    }
+
+    // if the previous pose does not explain most markers, try the pose of single markers
+    if(2 * bestCount <= nMarkers) {
+        vector< int > order((size_t)nMarkers);
+        for(int m = 0; m < nMarkers; m++)
+            order[m] = m;
+        if(nMarkers > iterationsCount) randShuffle(order);
+        int nHypotheses = min(nMarkers, iterationsCount);
+
+        for(int h = 0; h < nHypotheses && bestCount < nMarkers; h++) {
+            int m = order[h];
+            vector< Point3f > markerObjPoints(objPoints.begin() + 4 * m,
+                                              objPoints.begin() + 4 * m + 4);
+            vector< Point2f > markerImgPoints(imgPoints.begin() + 4 * m,
+                                              imgPoints.begin() + 4 * m + 4);
+            Mat rvec, tvec;
+            if(!solvePnP(markerObjPoints, markerImgPoints, _cameraMatrix, _distCoeffs, rvec, tvec,
+                         false, SOLVEPNP_P3P))
+                continue;
+
+            double error;
+            int count = _scoreBoardPose(objPoints, imgPoints, _cameraMatrix, _distCoeffs, rvec,
+                                        tvec, reprojectionThreshold, markerInliers, error);
+            if(count > bestCount || (count == bestCount && count > 0 && error < bestError)) {
+                bestCount = count;
+                bestError = error;
+                bestInliers.swap(markerInliers);
+                bestRvec = rvec;
+                bestTvec = tvec;
+            }
+        }
+    }
+
+    // refine with all the inliers starting from the best hypothesis. If the refined pose
+    // changes the inlier set, refine once more with the new set
+    for(int pass = 0; pass < 2 && bestCount > 0; pass++) {
+        vector< Point3f > inlierObjPoints;
+        vector< Point2f > inlierImgPoints;
+        for(int m = 0; m < nMarkers; m++) {
+            if(!bestInliers[m]) continue;
+            inlierObjPoints.insert(inlierObjPoints.end(), objPoints.begin() + 4 * m,
+                                   objPoints.begin() + 4 * m + 4);
+            inlierImgPoints.insert(inlierImgPoints.end(), imgPoints.begin() + 4 * m,
+                                   imgPoints.begin() + 4 * m + 4);
+        }
+
+        Mat rvec = bestRvec.clone(), tvec = bestTvec.clone();
+        solvePnP(inlierObjPoints, inlierImgPoints, _cameraMatrix, _distCoeffs, rvec, tvec, true,
+                 SOLVEPNP_ITERATIVE);
+
+        double error;
+        int count = _scoreBoardPose(objPoints, imgPoints, _cameraMatrix, _distCoeffs, rvec, tvec,
+                                    reprojectionThreshold, markerInliers, error);
+        // keep the previous solution if the refinement lost markers
+        if(count < bestCount) break;
+
+        bool sameInliers = markerInliers == bestInliers;
+        bestCount = count;
+        bestError = error;
+        bestInliers.swap(markerInliers);
+        bestRvec = rvec;
+        bestTvec = tvec;
+        if(sameInliers) break;
+    }
+
+    // parse output
+    if(_inliers.needed()) {
+        Mat inliers((int)_ids.total(), 1, CV_8UC1, Scalar::all(0));
+        for(int m = 0; m < nMarkers && bestCount > 0; m++)
+            inliers.ptr< uchar >()[markerIdxs[m]] = bestInliers[m];
+        inliers.copyTo(_inliers);
+    }
+    if(residual) *residual = bestCount > 0 ? sqrt(bestError / (4. * bestCount)) : 0.;
+
+    if(bestCount == 0) return 0;
+
+    bestRvec.copyTo(_rvec);
+    bestTvec.copyTo(_tvec);
+    return bestCount;
+}
+
+
+
+
 /**
  */
 void GridBoard::draw(Size outSize, OutputArray _img, int marginSize, int borderBits) {
@@ -82,6 +82,41 @@ enum CornerRefineMethod{
 	CORNER_REFINE_CONTOUR   // refine the corners using the contour-points
 };
 
+/**
+ * @brief Engines searching square candidates before their identification:
+ * - CANDIDATE_ENGINE_CONTOURS: adaptive thresholding at several window sizes, findContours and
+ *   polygonal approximation of every blob.
+ * - CANDIDATE_ENGINE_LINE_SEGMENTS: gradient edge pixels are clustered with union-find into line
+ *   segments, and closed chains of four segments become quads (in the style of AprilTag). Runs
+ *   once per image and keeps markers whose sides are partly occluded.
+ */
+enum CandidateEngine {
+	CANDIDATE_ENGINE_CONTOURS,
+	CANDIDATE_ENGINE_LINE_SEGMENTS
+};
+
+/**
+ * @brief Named detector profiles returned by DetectorParameters::create(int).
+ *
+ * Throughput and accuracy in the scenario of timur::ArucoMarkers::benchmarkDetectorPresets:
+ * synthetic 1280x720 images with one DICT_4X4_50 marker of 40..240 pixels, random perspective,
+ * 3x3 blur and noise (sigma 4), 300 images on one thread of an Intel Xeon server core. The
+ * decimation of FAST is reproduced by resize(INTER_AREA) and the pixel centre mapping of the
+ * candidates; rerun the benchmark for the numbers of the target build.
+ * - DETECTOR_PRESET_FAST: one threshold scale on a half-resolution image, no corner refinement and
+ *   2 pixels per cell when reading bits. 1.0 ms/frame, 90% detected (small markers are lost by the
+ *   decimation), corner RMS 3.05 px.
+ * - DETECTOR_PRESET_BALANCED: the default threshold scales with CORNER_REFINE_SUBPIX.
+ *   12.7 ms/frame, 100% detected, corner RMS 0.24 px.
+ * - DETECTOR_PRESET_ACCURATE: dense threshold scales, CORNER_REFINE_SUBPIX with a 7 pixel window
+ *   and 0.01 px accuracy, 8 pixels per cell. 34.2 ms/frame, 100% detected, corner RMS 0.22 px.
+ */
+enum DetectorPreset {
+	DETECTOR_PRESET_FAST,
+	DETECTOR_PRESET_BALANCED,
+	DETECTOR_PRESET_ACCURATE
+};
+
 /**
  * @brief Parameters for the detectMarker process:
  * - adaptiveThreshWinSizeMin: minimum window size for adaptive thresholding before finding
@@ -125,6 +160,18 @@ enum CornerRefineMethod{
  *   than 128 or not) (default 5.0)
  * - errorCorrectionRate error correction rate respect to the maximun error correction capability
  *   for each dictionary. (default 0.6).
+ * - imageDecimation: the candidate search runs on the input image downscaled by this factor, bits
+ *   are still read at full resolution. 1 disables decimation (default 1.0).
+ * - candidateEngine: engine searching the square candidates, see CandidateEngine
+ *   (default CANDIDATE_ENGINE_CONTOURS).
+ * - lineSegmentMinMagnitude: minimum Sobel gradient magnitude of an edge pixel for the line
+ *   segment engine (default 40).
+ * - lineSegmentMaxAngleDiff: maximum difference of gradient directions (in radians) of two
+ *   neighbour pixels of the same line segment (default 0.35). A segment also stops growing when
+ *   its range of gradient directions or magnitudes widens too much, so it does not bend around a
+ *   blurred corner.
+ * - lineSegmentMaxGapRate: maximum distance between the end of a segment and the start of the next
+ *   side of the quad, as a rate respect to the longer of the two segments (default 0.5).
  */
 struct CV_EXPORTS_W DetectorParameters {
 
@@ -132,6 +179,11 @@ struct CV_EXPORTS_W DetectorParameters {
 
 	CV_WRAP static Ptr<DetectorParameters> create();
 
+	/**
+	 * @brief Create a new set of DetectorParameters filled with one of the DetectorPreset profiles.
+	 */
+	CV_WRAP static Ptr<DetectorParameters> create(int preset);
+
 	CV_PROP_RW int adaptiveThreshWinSizeMin;
 	CV_PROP_RW int adaptiveThreshWinSizeMax;
 	CV_PROP_RW int adaptiveThreshWinSizeStep;
@@ -152,6 +204,11 @@ struct CV_EXPORTS_W DetectorParameters {
 	CV_PROP_RW double maxErroneousBitsInBorderRate;
 	CV_PROP_RW double minOtsuStdDev;
 	CV_PROP_RW double errorCorrectionRate;
+	CV_PROP_RW double imageDecimation;
+	CV_PROP_RW int candidateEngine;
+	CV_PROP_RW double lineSegmentMinMagnitude;
+	CV_PROP_RW double lineSegmentMaxAngleDiff;
+	CV_PROP_RW double lineSegmentMaxGapRate;
 };
 
 
@@ -174,17 +231,72 @@ struct CV_EXPORTS_W DetectorParameters {
  * \f$A = \vecthreethree{f_x}{0}{c_x}{0}{f_y}{c_y}{0}{0}{1}\f$
  * @param distCoeff optional vector of distortion coefficients
  * \f$(k_1, k_2, p_1, p_2[, k_3[, k_4, k_5, k_6],[s_1, s_2, s_3, s_4]])\f$ of 4, 5, 8 or 12 elements
+ * @param confidences optional vector of identification scores of the detected markers
+ * (e.g. std::vector<cv::Vec3i>), in the same order than ids. Each element holds the Hamming
+ * distance of the marker bits to the identified id, the distance to the closest other id of the
+ * dictionary, and the number of wrong border bits. A small gap between the first two values
+ * means an ambiguous detection.
  *
  * Performs marker detection in the input image. Only markers included in the specific dictionary
  * are searched. For each detected marker, it returns the 2D position of its corner in the image
- * and its corresponding identifier.
+ * and its corresponding identifier. Each candidate takes the id of the closest dictionary marker,
+ * if it is within the error correction capability.
  * Note that this function does not perform pose estimation.
  * @sa estimatePoseSingleMarkers,  estimatePoseBoard
  *
  */
 CV_EXPORTS_W void detectMarkers(InputArray image, const Ptr<Dictionary> &dictionary, OutputArrayOfArrays corners,
 								OutputArray ids, const Ptr<DetectorParameters> &parameters = DetectorParameters::create(),
-								OutputArrayOfArrays rejectedImgPoints = noArray(), InputArray cameraMatrix= noArray(), InputArray distCoeff= noArray());
+								OutputArrayOfArrays rejectedImgPoints = noArray(), InputArray cameraMatrix= noArray(), InputArray distCoeff= noArray(),
+								OutputArray confidences = noArray());
+
+
+
+/**
+ * @brief Marker detection over several frames at once
+ *
+ * @param images input frames, e.g. one frame from each camera or a burst from one camera
+ * (e.g std::vector<cv::Mat>).
+ * @param dictionary indicates the type of markers that will be searched
+ * @param corners detected marker corners of each frame, in the format of detectMarkers. The size
+ * of this vector is the number of frames.
+ * @param ids identifiers of the detected markers of each frame, in the format of detectMarkers.
+ * @param parameters marker detection parameters, shared by all the frames
+ * @param cameraMatrix optional input 3x3 floating-point camera matrix
+ * @param distCoeff optional vector of distortion coefficients
+ *
+ * Each stage of the detection runs as one parallel loop over the tasks of all the frames: the
+ * candidate search over every frame and threshold window size, the identification over every
+ * candidate and the subpixel refinement over every corner. Few frames still keep all the cores
+ * busy. The results are the same as calling detectMarkers on each frame.
+ * @sa detectMarkers
+ */
+CV_EXPORTS void detectMarkersBatch(InputArrayOfArrays images, const Ptr<Dictionary> &dictionary,
+								   std::vector< std::vector< std::vector< Point2f > > > &corners,
+								   std::vector< std::vector< int > > &ids,
+								   const Ptr<DetectorParameters> &parameters = DetectorParameters::create(),
+								   InputArray cameraMatrix = noArray(), InputArray distCoeff = noArray());
+
+
+
+/**
+ * @brief Sample the inner bits of a marker candidate
+ *
+ * @param image input image
+ * @param corners four corners of the candidate, in the order of detectMarkers output, e.g. one of
+ * the rejectedImgPoints of detectMarkers.
+ * @param dictionary dictionary of the markers, it gives the marker size
+ * @param bits output markerSize x markerSize CV_8UC1 matrix of 0 and 1, without the border bits.
+ * @param parameters marker detection parameters, the same used by detectMarkers
+ *
+ * The bits are sampled exactly as detectMarkers samples them before identification, so they can
+ * be kept for a few frames and compared with Dictionary::getDistanceToId, e.g. to recover a marker
+ * that is blurred or partially occluded on the current frame.
+ * @sa detectMarkers, Dictionary::getDistanceToId
+ */
+CV_EXPORTS void extractMarkerBits(InputArray image, InputArray corners, const Ptr<Dictionary> &dictionary,
+								  OutputArray bits,
+								  const Ptr<DetectorParameters> &parameters = DetectorParameters::create());
 
 
 
@@ -361,6 +473,44 @@ CV_EXPORTS_W int estimatePoseBoard(InputArrayOfArrays corners, InputArray ids, c
 
 
 
+/**
+ * @brief Outlier-robust pose estimation for a board of markers
+ *
+ * @param corners vector of already detected markers corners, as in estimatePoseBoard.
+ * @param ids list of identifiers for each marker in corners
+ * @param board layout of markers in the board.
+ * @param cameraMatrix input 3x3 floating-point camera matrix
+ * \f$A = \vecthreethree{f_x}{0}{c_x}{0}{f_y}{c_y}{0}{0}{1}\f$
+ * @param distCoeffs vector of distortion coefficients
+ * \f$(k_1, k_2, p_1, p_2[, k_3[, k_4, k_5, k_6],[s_1, s_2, s_3, s_4]])\f$ of 4, 5, 8 or 12 elements
+ * @param rvec rotation vector of the board (see cv::Rodrigues). If useExtrinsicGuess is set, its
+ * input value is the pose of the previous frame.
+ * @param tvec translation vector of the board.
+ * @param useExtrinsicGuess defines whether the input \b rvec and \b tvec are used as warm start.
+ * @param inliers optional output vector with one value per input marker, 1 if the marker agrees
+ * with the returned pose and 0 if it is an outlier or it is not part of the board.
+ * @param residual optional output with the RMS reprojection error of the inlier corners, in pixels.
+ * @param reprojectionThreshold maximum reprojection error of a marker corner, in pixels, for the
+ * marker to be considered an inlier.
+ * @param iterationsCount maximum number of pose hypotheses.
+ *
+ * Each hypothesis is the pose of a single marker, computed with the P3P solver from its four
+ * corners, and it is scored by the number of board markers whose corners all reproject below
+ * reprojectionThreshold. If there are no more markers than iterationsCount every marker is
+ * tried, otherwise the markers are sampled randomly. If a previous pose is given and it already
+ * explains most markers, the hypotheses are skipped. The pose is finally refined from the best
+ * hypothesis using only the inlier markers.
+ * The function returns the number of inlier markers; 0 means the pose has not been estimated.
+ */
+CV_EXPORTS int estimatePoseBoardRobust(InputArrayOfArrays corners, InputArray ids,
+									   const Ptr<Board> &board, InputArray cameraMatrix,
+									   InputArray distCoeffs, InputOutputArray rvec, InputOutputArray tvec,
+									   bool useExtrinsicGuess = false, OutputArray inliers = noArray(),
+									   double *residual = 0, float reprojectionThreshold = 3.f,
+									   int iterationsCount = 100);
+
+
+
 
 /**
  * @brief Refind not detected markers based on the already detected and the board layout
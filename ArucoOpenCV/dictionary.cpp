@@ -42,6 +42,7 @@ the use of this software, even if advised of the possibility of such damage.
 #include <opencv2/imgproc.hpp>
 #include "predefined_dictionaries.hpp"
 #include "opencv2/core/hal/hal.hpp"
+#include <algorithm>
 
 namespace cv {
 namespace aruco {
@@ -49,12 +50,77 @@ namespace aruco {
 using namespace std;
 
 
+/**
+  * @brief Codes of all markers in the 4 rotations, sorted by (first byte, second byte, id).
+  * Entries with the same first byte form a first level group, entries with the same two first
+  * bytes a second level group. A missing second byte (1 byte codes) is taken as 0.
+  */
+struct DictionaryPrefixIndex {
+    Mat source;  // bytesList the index was built from, keeps its data alive
+    int nbytes;
+
+    Mat codes;                   // one code per row, in sorted order
+    vector< int > ids;           // marker id of each code
+    vector< uchar > firstBytes;  // first byte of each first level group
+    vector< int > firstStart;    // range of second level groups of each first level group
+    vector< uchar > secondBytes; // second byte of each second level group
+    vector< int > secondStart;   // range of codes of each second level group
+
+    DictionaryPrefixIndex(const Mat &bytesList)
+        : source(bytesList), nbytes(bytesList.cols) {
+
+        // sort all codes by their two first bytes, ties by id
+        int nCodes = 4 * bytesList.rows;
+        vector< int > order((size_t)nCodes);
+        for(int i = 0; i < nCodes; i++)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), [&](int a, int b) {
+            int keyA = _key(bytesList.ptr(a / 4) + (a % 4) * nbytes);
+            int keyB = _key(bytesList.ptr(b / 4) + (b % 4) * nbytes);
+            return keyA != keyB ? keyA < keyB : a < b;
+        });
+
+        codes.create(nCodes, nbytes, CV_8UC1);
+        ids.resize((size_t)nCodes);
+        for(int i = 0; i < nCodes; i++) {
+            const uchar *code = bytesList.ptr(order[i] / 4) + (order[i] % 4) * nbytes;
+            std::copy(code, code + nbytes, codes.ptr(i));
+            ids[i] = order[i] / 4;
+
+            int key = _key(code);
+            bool newFirst = i == 0 || (key >> 8) != firstBytes.back();
+            if(newFirst) {
+                firstBytes.push_back((uchar)(key >> 8));
+                firstStart.push_back((int)secondBytes.size());
+            }
+            if(newFirst || (key & 255) != secondBytes.back()) {
+                secondBytes.push_back((uchar)(key & 255));
+                secondStart.push_back(i);
+            }
+        }
+        firstStart.push_back((int)secondBytes.size());
+        secondStart.push_back(nCodes);
+    }
+
+    int _key(const uchar *code) const {
+        return (code[0] << 8) | (nbytes > 1 ? code[1] : 0);
+    }
+
+    bool isBuiltFrom(const Mat &bytesList) const {
+        return source.data == bytesList.data && source.rows == bytesList.rows &&
+               source.cols == bytesList.cols;
+    }
+};
+
+
+
 /**
   */
 Dictionary::Dictionary(const Ptr<Dictionary> &_dictionary) {
     markerSize = _dictionary->markerSize;
     maxCorrectionBits = _dictionary->maxCorrectionBits;
     bytesList = _dictionary->bytesList.clone();
+    rebuildIndex();
 }
 
 
@@ -64,6 +130,7 @@ Dictionary::Dictionary(const Mat &_bytesList, int _markerSize, int _maxcorr) {
     markerSize = _markerSize;
     maxCorrectionBits = _maxcorr;
     bytesList = _bytesList;
+    rebuildIndex();
 }
 
 
@@ -90,6 +157,44 @@ Ptr<Dictionary> Dictionary::get(int dict) {
 }
 
 
+/**
+  * @brief Number of set bits of every byte value
+  */
+static const uchar *_popCountTable() {
+    struct PopCountTable {
+        uchar values[256];
+        PopCountTable() {
+            values[0] = 0;
+            for(int v = 1; v < 256; v++)
+                values[v] = (uchar)((v & 1) + values[v >> 1]);
+        }
+    };
+    // local static, initialized once even if called from several threads
+    static const PopCountTable table;
+    return table.values;
+}
+
+
+
+/**
+ */
+void Dictionary::rebuildIndex() {
+    prefixIndex = makePtr< DictionaryPrefixIndex >(bytesList);
+}
+
+
+/**
+ */
+Ptr< DictionaryPrefixIndex > Dictionary::_getPrefixIndex() const {
+    // the stored index is only read here, so concurrent calls need no lock. A replaced bytesList
+    // is caught, an edit in place is not
+    if(!prefixIndex || !prefixIndex->isBuiltFrom(bytesList))
+        CV_Error(Error::StsError, "bytesList was changed, call Dictionary::rebuildIndex()");
+    return prefixIndex;
+}
+
+
+
 /**
  */
 bool Dictionary::identify(const Mat &onlyBits, int &idx, int &rotation,
@@ -99,6 +204,129 @@ bool Dictionary::identify(const Mat &onlyBits, int &idx, int &rotation,
 
     int maxCorrectionRecalculed = int(double(maxCorrectionBits) * maxCorrectionRate);
 
+    // get as a byte list
+    Mat candidateBytes = getByteListFromBits(onlyBits);
+    const uchar *candidate = candidateBytes.ptr();
+    int nbytes = candidateBytes.cols;
+
+    Ptr< DictionaryPrefixIndex > index = _getPrefixIndex();
+    const uchar *popCount = _popCountTable();
+    uchar candidateSecond = nbytes > 1 ? candidate[1] : 0;
+
+    // lowest id with any rotation inside the correction budget, as the linear scan returns.
+    // Groups are skipped when the distance of their prefix alone exceeds the budget
+    idx = bytesList.rows;
+    for(size_t f = 0; f < index->firstBytes.size(); f++) {
+        int firstDistance = popCount[index->firstBytes[f] ^ candidate[0]];
+        if(firstDistance > maxCorrectionRecalculed) continue;
+
+        for(int g = index->firstStart[f]; g < index->firstStart[f + 1]; g++) {
+            int prefixDistance = firstDistance + popCount[index->secondBytes[g] ^ candidateSecond];
+            if(prefixDistance > maxCorrectionRecalculed) continue;
+
+            // codes of the group are sorted by id, so stop at the best id found so far
+            for(int c = index->secondStart[g]; c < index->secondStart[g + 1]; c++) {
+                if(index->ids[c] >= idx) break;
+                int distance = prefixDistance;
+                if(nbytes > 2)
+                    distance += cv::hal::normHamming(index->codes.ptr(c) + 2, candidate + 2,
+                                                     nbytes - 2);
+                if(distance <= maxCorrectionRecalculed) {
+                    idx = index->ids[c];
+                    break;
+                }
+            }
+        }
+    }
+
+    if(idx == bytesList.rows) {
+        idx = -1;
+        return false;
+    }
+
+    // rotation with the minimum distance, first one on ties
+    int currentMinDistance = markerSize * markerSize + 1;
+    for(int r = 0; r < 4; r++) {
+        int currentHamming =
+            cv::hal::normHamming(bytesList.ptr(idx) + r * nbytes, candidate, nbytes);
+        if(currentHamming < currentMinDistance) {
+            currentMinDistance = currentHamming;
+            rotation = r;
+        }
+    }
+    return true;
+}
+
+
+/**
+ */
+void Dictionary::identifyClosest(const Mat &onlyBits, int &idx, int &rotation, int &distance,
+                                 int &secondDistance) const {
+
+    CV_Assert(onlyBits.rows == markerSize && onlyBits.cols == markerSize);
+    CV_Assert(bytesList.rows > 0);
+
+    // get as a byte list
+    Mat candidateBytes = getByteListFromBits(onlyBits);
+    const uchar *candidate = candidateBytes.ptr();
+    int nbytes = candidateBytes.cols;
+
+    Ptr< DictionaryPrefixIndex > index = _getPrefixIndex();
+    const uchar *popCount = _popCountTable();
+    uchar candidateSecond = nbytes > 1 ? candidate[1] : 0;
+
+    // best and runner-up over distinct ids. A group can only change them if its prefix is not
+    // farther than the runner-up, so the search narrows as closer codes are found
+    idx = -1;
+    distance = secondDistance = markerSize * markerSize + 1;
+    for(size_t f = 0; f < index->firstBytes.size(); f++) {
+        int firstDistance = popCount[index->firstBytes[f] ^ candidate[0]];
+        if(firstDistance > secondDistance) continue;
+
+        for(int g = index->firstStart[f]; g < index->firstStart[f + 1]; g++) {
+            int prefixDistance = firstDistance + popCount[index->secondBytes[g] ^ candidateSecond];
+            if(prefixDistance > secondDistance) continue;
+
+            for(int c = index->secondStart[g]; c < index->secondStart[g + 1]; c++) {
+                int currentDistance = prefixDistance;
+                if(nbytes > 2)
+                    currentDistance += cv::hal::normHamming(index->codes.ptr(c) + 2,
+                                                            candidate + 2, nbytes - 2);
+                int currentId = index->ids[c];
+                if(currentId == idx) {
+                    // another rotation of the best marker
+                    distance = min(distance, currentDistance);
+                } else if(currentDistance < distance ||
+                          (currentDistance == distance && currentId < idx)) {
+                    secondDistance = distance;
+                    distance = currentDistance;
+                    idx = currentId;
+                } else if(currentDistance < secondDistance) {
+                    secondDistance = currentDistance;
+                }
+            }
+        }
+    }
+
+    // rotation with the minimum distance, first one on ties
+    for(int r = 0; r < 4; r++) {
+        if(cv::hal::normHamming(bytesList.ptr(idx) + r * nbytes, candidate, nbytes) == distance) {
+            rotation = r;
+            break;
+        }
+    }
+}
+
+
+/**
+ */
+bool Dictionary::identifyLinear(const Mat &onlyBits, int &idx, int &rotation,
+                                double maxCorrectionRate) const {
+
+    CV_Assert(onlyBits.rows == markerSize && onlyBits.cols == markerSize);
+
+    int maxCorrectionRecalculed = int(double(maxCorrectionBits) * maxCorrectionRate);
+
     // get as a byte list
     Mat candidateBytes = getByteListFromBits(onlyBits);
 
@@ -185,7 +413,6 @@ void Dictionary::drawMarker(int id, int sidePixels, OutputArray _img, int border
 
 
 
-
 /**
   * @brief Transform matrix of bits to list of bytes in the 4 rotations
   */
@@ -266,7 +493,6 @@ Mat Dictionary::getBitsFromByteList(const Mat &byteList, int markerSize) {
 
 
 
-
 // DictionaryData constructors calls
 const Dictionary DICT_ARUCO_DATA = Dictionary(Mat(1024, (5*5 + 7)/8, CV_8UC4, (uchar*)DICT_ARUCO_BYTES), 5, 0);
 
@@ -461,6 +687,7 @@ Ptr<Dictionary> generateCustomDictionary(int nMarkers, int markerSize,
     // update the maximum number of correction bits for the generated dictionary
     out->maxCorrectionBits = (tau - 1) / 2;
 
+    out->rebuildIndex();
     return out;
 }
 
@@ -48,6 +48,9 @@ namespace aruco {
 //! @{
 
 
+struct DictionaryPrefixIndex;
+
+
 /**
  * @brief Dictionary/Set of markers. It contains the inner codification
  *
@@ -104,6 +107,21 @@ class CV_EXPORTS_W Dictionary {
      */
     bool identify(const Mat &onlyBits, int &idx, int &rotation, double maxCorrectionRate) const;
 
+    /**
+     * @brief Finds the marker closest to the bits over all ids and rotations.
+     * It returns by reference its id, rotation and Hamming distance, and the distance of the
+     * closest marker with another id (runner-up). On equal distances the lowest id is taken.
+     */
+    void identifyClosest(const Mat &onlyBits, int &idx, int &rotation, int &distance,
+                         int &secondDistance) const;
+
+    /**
+     * @brief Same result as identify, computed by comparing the full codes of every marker.
+     * Kept as a reference for the prefix-pruned search of identify.
+     */
+    bool identifyLinear(const Mat &onlyBits, int &idx, int &rotation,
+                        double maxCorrectionRate) const;
+
     /**
       * @brief Returns the distance of the input bits to the specific id. If allRotations is true,
       * the four posible bits rotation are considered
@@ -127,6 +145,24 @@ class CV_EXPORTS_W Dictionary {
       * @brief Transform list of bytes to matrix of bits
       */
     static Mat getBitsFromByteList(const Mat &byteList, int markerSize);
+
+
+    /**
+      * @brief Rebuild the search index of identify and identifyClosest from bytesList. The
+      * constructors build it, call it after changing bytesList (identify fails if bytesList was
+      * replaced without it, an edit in place is not detected).
+      */
+    CV_WRAP void rebuildIndex();
+
+
+    private:
+    /**
+      * @brief Codes of all markers in the 4 rotations grouped by their first two bytes, so that
+      * identify can skip whole groups whose prefix already exceeds the correction budget.
+      */
+    Ptr< DictionaryPrefixIndex > _getPrefixIndex() const;
+
+    Ptr< DictionaryPrefixIndex > prefixIndex;
 };
 
 
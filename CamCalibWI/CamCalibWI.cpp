@@ -1,11 +1,175 @@
 #include "CamCalibWI.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include <opencv2/shape/hist_cost.hpp>
 #include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
 
-timur::CamCalibWi::CamCalibWi(const cv::Size boardDimension, const uint patternCode)
-	: CameraCalibration(boardDimension, patternCode)
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+/**
+ * \brief Maximum width of the frame used for preview detection.
+ */
+const int previewWidth = 640;
+
+/**
+ * \brief First bytes of a calibration file.
+ */
+const char calibrationSignature[4] = {'C', 'C', 'A', 'L'};
+
+/**
+ * \brief Version of the calibration file format.
+ */
+const std::uint32_t calibrationVersion = 1;
+
+/**
+ * \brief Alignment of the maps in the calibration file.
+ */
+const size_t calibrationAlignment = 64;
+
+/**
+ * \brief Maximum count of distortion coefficients in OpenCV models.
+ */
+const std::uint32_t maxDistortionCoefficients = 14;
+
+/**
+ * \brief Header of the calibration file. It is followed by two maps of cv::remap (CV_16SC2 and
+ * CV_16UC1, imageSize each) at the offsets, the offsets are zero if there are no maps.
+ */
+struct CalibrationFileHeader
+{
+	char signature[4];
+	std::uint32_t version;
+	std::int32_t width;
+	std::int32_t height;
+	double cameraMatrix[9];
+	double distortionCoefficients[maxDistortionCoefficients];
+	std::uint32_t countOfDistortionCoefficients;
+	std::uint32_t reserved;
+	std::uint64_t map1Offset;
+	std::uint64_t map2Offset;
+};
+
+static_assert(sizeof(CalibrationFileHeader) == 224, "calibration file header must not be padded");
+
+/**
+ * \brief Stopping and joining the worker thread when the scope is left, also by an exception, so
+ * a joinable std::thread is never destroyed (it would call std::terminate).
+ */
+class WorkerGuard
+{
+public:
+	WorkerGuard(std::thread& worker, std::function<void()> stop)
+		: _worker(worker),
+		  _stop(std::move(stop))
+	{
+	}
+
+	WorkerGuard(const WorkerGuard&) = delete;
+	WorkerGuard& operator=(const WorkerGuard&) = delete;
+
+	~WorkerGuard()
+	{
+		_stop();
+		if (_worker.joinable())
+		{
+			_worker.join();
+		}
+	}
+
+private:
+	std::thread& _worker;
+	std::function<void()> _stop;
+};
+
+/**
+ * \brief Rounding the offset up to calibrationAlignment.
+ */
+std::uint64_t alignedOffset(const std::uint64_t offset)
+{
+	return (offset + calibrationAlignment - 1) / calibrationAlignment * calibrationAlignment;
+}
+
+/**
+ * \brief Mapping the file to memory for reading.
+ * \param[in] name Name of the file.
+ * \param[out] size Size of the file.
+ * \return Start of the mapped file, unmapped with the last copy of the pointer (null on error).
+ */
+std::shared_ptr<const char> mapFile(const std::string& name, size_t& size)
+{
+#ifdef _WIN32
+	const HANDLE file = CreateFileA(name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return nullptr;
+	}
+	LARGE_INTEGER fileSize;
+	const HANDLE mapping = GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0
+		? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr)
+		: nullptr;
+	CloseHandle(file);
+	if (mapping == nullptr)
+	{
+		return nullptr;
+	}
+	const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (view == nullptr)
+	{
+		return nullptr;
+	}
+	size = static_cast<size_t>(fileSize.QuadPart);
+	return std::shared_ptr<const char>(static_cast<const char*>(view),
+		[](const char* data) { UnmapViewOfFile(data); });
+#else
+	const int file = open(name.c_str(), O_RDONLY);
+	if (file < 0)
+	{
+		return nullptr;
+	}
+	struct stat fileStat;
+	void* view = fstat(file, &fileStat) == 0 && fileStat.st_size > 0
+		? mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0)
+		: MAP_FAILED;
+	close(file);
+	if (view == MAP_FAILED)
+	{
+		return nullptr;
+	}
+	const size_t mappedSize = static_cast<size_t>(fileStat.st_size);
+	size = mappedSize;
+	return std::shared_ptr<const char>(static_cast<const char*>(view),
+		[mappedSize](const char* data) { munmap(const_cast<char*>(data), mappedSize); });
+#endif
+}
+}
+
+timur::CamCalibWi::CamCalibWi(const cv::Size boardDimension, const uint patternCode,
+	const float squareLength, const float markerLength, const int charucoDictionaryId)
+	: CameraCalibration(boardDimension, patternCode, squareLength, markerLength,
+		charucoDictionaryId)
 {
 }
 
@@ -15,44 +179,123 @@ timur::CamCalibWi::CamCalibWi(const std::string& calibrationFileName)
 	loadCameraCalibration(calibrationFileName);
 }
 
-void timur::CamCalibWi::saveCameraCalibration(const std::string& name) const
+bool timur::CamCalibWi::saveCameraCalibration(const std::string& name, const bool withMaps) const
 {
-	std::ofstream outStream(name);
-	if (outStream)
+	if (_cameraMatrix.empty())
 	{
-		outStream << _cameraMatrix.rows << '\n';
-		outStream << _cameraMatrix.cols << '\n';
+		return false;
+	}
+	std::ofstream outStream(name, std::ios::binary);
+	if (!outStream)
+	{
+		return false;
+	}
 
-		for (int r = 0; r < _cameraMatrix.rows; ++r)
-		{
-			for (int c = 0; c < _cameraMatrix.cols; ++c)
-			{
-				outStream << _cameraMatrix.at<double>(r, c) << '\n';
-			}
-		}
+	CalibrationFileHeader header = {};
+	std::memcpy(header.signature, calibrationSignature, sizeof(header.signature));
+	header.version = calibrationVersion;
+	header.width = _imageSize.width;
+	header.height = _imageSize.height;
+	const cv::Mat cameraMatrix = cv::Mat_<double>(_cameraMatrix);
+	std::copy(cameraMatrix.ptr<double>(), cameraMatrix.ptr<double>() + 9, header.cameraMatrix);
+	const cv::Mat distortionCoefficients = _distortionCoefficients.empty()
+		? cv::Mat()
+		: cv::Mat(cv::Mat_<double>(_distortionCoefficients.reshape(1, 1)));
+	header.countOfDistortionCoefficients = static_cast<std::uint32_t>(std::min<size_t>(
+		distortionCoefficients.total(), maxDistortionCoefficients));
+	std::copy(distortionCoefficients.ptr<double>(),
+		distortionCoefficients.ptr<double>() + header.countOfDistortionCoefficients,
+		header.distortionCoefficients);
 
-		outStream << _distortionCoefficients.rows << '\n';
-		outStream << _distortionCoefficients.cols << '\n';
+	// fixed-point maps for cv::remap, aligned so they can be used in place from a mapped file
+	cv::Mat map1, map2;
+	if (withMaps && !_imageSize.empty())
+	{
+		cv::initUndistortRectifyMap(cameraMatrix, distortionCoefficients, cv::Mat(), cameraMatrix,
+			_imageSize, CV_16SC2, map1, map2);
+		header.map1Offset = alignedOffset(sizeof(header));
+		header.map2Offset = alignedOffset(header.map1Offset + map1.total() * map1.elemSize());
+	}
+
+	outStream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	if (!map1.empty())
+	{
+		const std::vector<char> padding(calibrationAlignment, 0);
+		outStream.write(padding.data(), header.map1Offset - sizeof(header));
+		outStream.write(map1.ptr<char>(), map1.total() * map1.elemSize());
+		outStream.write(padding.data(),
+			header.map2Offset - header.map1Offset - map1.total() * map1.elemSize());
+		outStream.write(map2.ptr<char>(), map2.total() * map2.elemSize());
+	}
+	return static_cast<bool>(outStream);
+}
 
-		for (int r = 0; r < _distortionCoefficients.rows; ++r)
+void timur::CamCalibWi::loadCameraCalibration(const std::string& name)
+{
+	char signature[sizeof(calibrationSignature)] = {};
+	{
+		std::ifstream inStream(name, std::ios::binary);
+		if (!inStream.is_open())
 		{
-			for (int c = 0; c < _distortionCoefficients.cols; ++c)
-			{
-				outStream << _distortionCoefficients.at<double>(r, c) << '\n';
-			}
+			std::cout << "Can not open file! Wrong name!" << '\n';
+			return;
 		}
+		inStream.read(signature, sizeof(signature));
+	}
 
-		outStream.close();
+	const bool loaded = std::memcmp(signature, calibrationSignature, sizeof(signature)) == 0
+		? loadBinaryCalibration(name)
+		: loadLegacyCalibration(name);
+	if (!loaded)
+	{
+		std::cout << "Can not read calibration from " << name << '\n';
 	}
 }
 
-void timur::CamCalibWi::loadCameraCalibration(const std::string& name)
+bool timur::CamCalibWi::loadBinaryCalibration(const std::string& name)
+{
+	size_t fileSize = 0;
+	const std::shared_ptr<const char> mappedFile = mapFile(name, fileSize);
+	if (!mappedFile || fileSize < sizeof(CalibrationFileHeader))
+	{
+		return false;
+	}
+	CalibrationFileHeader header;
+	std::memcpy(&header, mappedFile.get(), sizeof(header));
+	if (header.version != calibrationVersion
+		|| header.countOfDistortionCoefficients > maxDistortionCoefficients)
+	{
+		return false;
+	}
+
+	_cameraMatrix = cv::Mat(3, 3, CV_64F, header.cameraMatrix).clone();
+	_distortionCoefficients = cv::Mat(1, static_cast<int>(header.countOfDistortionCoefficients),
+		CV_64F, header.distortionCoefficients).clone();
+	_imageSize = cv::Size(header.width, header.height);
+
+	// maps are not copied, they stay in the mapped file as long as the object lives
+	_undistortMap1 = cv::Mat();
+	_undistortMap2 = cv::Mat();
+	_mappedCalibration.reset();
+	const size_t map1Size = _imageSize.area() * 2 * sizeof(short);
+	const size_t map2Size = _imageSize.area() * sizeof(ushort);
+	if (header.map1Offset != 0 && !_imageSize.empty() && header.map2Offset >= header.map1Offset + map1Size
+		&& header.map2Offset + map2Size <= fileSize)
+	{
+		char* data = const_cast<char*>(mappedFile.get());
+		_undistortMap1 = cv::Mat(_imageSize, CV_16SC2, data + header.map1Offset);
+		_undistortMap2 = cv::Mat(_imageSize, CV_16UC1, data + header.map2Offset);
+		_mappedCalibration = mappedFile;
+	}
+	return true;
+}
+
+bool timur::CamCalibWi::loadLegacyCalibration(const std::string& name)
 {
 	std::ifstream inStream(name);
 	if (!inStream.is_open())
 	{
-		std::cout << "Can not open file! Wrong name!" << '\n';
-		return;
+		return false;
 	}
 
 	int rows;
@@ -60,33 +303,50 @@ void timur::CamCalibWi::loadCameraCalibration(const std::string& name)
 
 	inStream >> rows;
 	inStream >> columns;
+	if (!inStream || rows <= 0 || columns <= 0)
+	{
+		return false;
+	}
 
-	_cameraMatrix = cv::Mat(cv::Size(columns, rows), cv::DataType<double>::type);
+	cv::Mat cameraMatrix(cv::Size(columns, rows), cv::DataType<double>::type);
 
 	for (int r = 0; r < rows; ++r)
 	{
 		for (int c = 0; c < columns; ++c)
 		{
-			inStream >> _cameraMatrix.at<double>(r, c);
-			std::cout << _cameraMatrix.at<double>(r, c) << '\n';
+			inStream >> cameraMatrix.at<double>(r, c);
 		}
 	}
 
 	inStream >> rows;
 	inStream >> columns;
+	if (!inStream || rows <= 0 || columns <= 0)
+	{
+		return false;
+	}
 
-	_distortionCoefficients = cv::Mat::zeros(rows, columns, cv::DataType<double>::type);
+	cv::Mat distortionCoefficients = cv::Mat::zeros(rows, columns, cv::DataType<double>::type);
 
 	for (int r = 0; r < rows; ++r)
 	{
 		for (int c = 0; c < columns; ++c)
 		{
-			inStream >> _distortionCoefficients.at<double>(r, c);
-			std::cout << _distortionCoefficients.at<double>(r, c) << '\n';
+			inStream >> distortionCoefficients.at<double>(r, c);
 		}
 	}
-	std::cout << '\n';
-	inStream.close();
+	if (!inStream)
+	{
+		return false;
+	}
+
+	// the text format has no image size, so there are no precomputed maps
+	_cameraMatrix = cameraMatrix;
+	_distortionCoefficients = distortionCoefficients;
+	_imageSize = cv::Size();
+	_undistortMap1 = cv::Mat();
+	_undistortMap2 = cv::Mat();
+	_mappedCalibration.reset();
+	return true;
 }
 
 cv::Mat timur::CamCalibWi::undistort(cv::Mat& inputImage) const
@@ -96,34 +356,58 @@ cv::Mat timur::CamCalibWi::undistort(cv::Mat& inputImage) const
 		return inputImage;
 	}
 	cv::Mat outputImage;
+	if (!_undistortMap1.empty() && inputImage.size() == _undistortMap1.size())
+	{
+		cv::remap(inputImage, outputImage, _undistortMap1, _undistortMap2, cv::INTER_LINEAR);
+		return outputImage;
+	}
 	cv::undistort(inputImage, outputImage, _cameraMatrix, _distortionCoefficients);
 	return outputImage;
 }
 
 float timur::CamCalibWi::calcBlurriness(const cv::Mat& src)
 {
-	cv::Mat gx, gy;
-	cv::Sobel(src, gx, CV_32F, 1, 0);
-	cv::Sobel(src, gy, CV_32F, 0, 1);
-	const double normGx = cv::norm(gx);
-	const double normGy = cv::norm(gy);
-	const double sumSq = normGx * normGx + normGy * normGy;
-	return static_cast<float>(1. / (sumSq / src.size().area() + 1e-6));
+	return static_cast<float>(1. / (FocusMeter::gradientEnergy(src, cv::Rect(), 2) + 1e-6));
 }
 
-void timur::CamCalibWi::focusSetting(cv::VideoCapture& vid)
+void timur::CamCalibWi::focusSetting(cv::VideoCapture& vid, const cv::Rect roi)
 {
+	FocusMeter focusMeter(roi);
 	while (true)
 	{
 		cv::Mat temp;
 		vid >> temp;
-		cv::putText(temp, std::to_string(calcBlurriness(temp)), cv::Point(50, 50),
+		if (temp.empty())
+		{
+			break;
+		}
+		focusMeter.submit(temp);
+
+		// the reading lags the shown frame by at most one frame
+		const FocusMeter::Reading reading = focusMeter.reading();
+		const double relative = reading.maximum > 0.0 ? reading.value / reading.maximum : 0.0;
+		cv::putText(temp, std::to_string(reading.value), cv::Point(50, 50),
 			cv::FONT_HERSHEY_SIMPLEX, 2, cv::Scalar(0, 0, 255));
+		cv::putText(temp, "min " + std::to_string(reading.minimum) + " peak "
+			+ std::to_string(reading.maximum), cv::Point(50, 90),
+			cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(0, 0, 255));
+		cv::rectangle(temp, cv::Rect(50, 110, static_cast<int>(300 * relative), 20),
+			cv::Scalar(0, 255, 0), CV_FILLED);
+		cv::rectangle(temp, cv::Rect(50, 110, 300, 20), cv::Scalar(0, 0, 255));
+		if (roi.area() > 0)
+		{
+			cv::rectangle(temp, roi, cv::Scalar(0, 255, 0));
+		}
 		cv::imshow("Image View", temp);
-		if (cv::waitKey(1) == 27)
+		const int key = cv::waitKey(1);
+		if (key == 27)
 		{
 			break;
 		}
+		if (key == 'r')
+		{
+			focusMeter.resetRange();
+		}
 	}
 }
 
@@ -134,76 +418,357 @@ void timur::CamCalibWi::cameraCalibrationImagesFromFolder(const std::string& fol
 	{
 		return;
 	}
-	std::vector<cv::Mat> calibrationImages;
-	cv::Mat imageGray;
+	std::vector<std::string> calibrationImageFiles;
 	for (uint i = 0; i < countOfImages; ++i)
 	{
-		cv::cvtColor(cv::imread(folderName + '/' + std::to_string(i) + ".png"), imageGray,
-			CV_BGR2GRAY);
-		calibrationImages.push_back(imageGray);
+		calibrationImageFiles.push_back(folderName + '/' + std::to_string(i) + ".png");
 	}
-	calculateIntrinsicParameters(calibrationImages);
+	// the cache lies next to the folder and is keyed by content, so renamed images still hit it
+	std::string cacheFileName = folderName;
+	while (cacheFileName.size() > 1
+		&& (cacheFileName.back() == '/' || cacheFileName.back() == '\\'))
+	{
+		cacheFileName.pop_back();
+	}
+	calculateIntrinsicParameters(calibrationImageFiles, printProgress, cacheFileName + ".corners");
+}
+
+void timur::CamCalibWi::calibrateAndSave(const std::vector<cv::Mat>& images)
+{
+	std::cout << "Started calibration.." << '\n';
+	calculateIntrinsicParameters(images, printProgress);
+	std::cout << "Saving calibration parametrs.." << '\n';
+	saveCameraCalibration("CamCalib.bin");
+	std::cout << "Saved!" << '\n';
 }
 
-void timur::CamCalibWi::cameraCalibrationProcess(cv::VideoCapture& vid, const uint countOfFrames)
+bool timur::CamCalibWi::estimateBoardRotation(const std::vector<cv::Point2f>& corners,
+	const std::vector<int>& ids, const cv::Size imageSize, const cv::Mat& cameraMatrix,
+	const cv::Mat& distortionCoefficients, cv::Vec3d& rotationVector) const
+{
+	std::vector<cv::Point3f> knownBoardPosition;
+	createKnownBoardPosition(knownBoardPosition);
+	std::vector<cv::Point3f> objectPoints;
+	if (ids.empty())
+	{
+		objectPoints = knownBoardPosition;
+	}
+	else
+	{
+		for (const int id : ids)
+		{
+			objectPoints.push_back(knownBoardPosition[id]);
+		}
+	}
+	if (objectPoints.size() < 4 || objectPoints.size() != corners.size())
+	{
+		return false;
+	}
+
+	// before calibration the focal length is guessed, it is enough to tell the tilts apart
+	cv::Mat usedCameraMatrix = cameraMatrix;
+	cv::Mat usedDistortionCoefficients = distortionCoefficients;
+	if (usedCameraMatrix.empty())
+	{
+		const double focalLength = std::max(imageSize.width, imageSize.height);
+		usedCameraMatrix = (cv::Mat_<double>(3, 3) << focalLength, 0, imageSize.width / 2.0,
+			0, focalLength, imageSize.height / 2.0,
+			0, 0, 1);
+		usedDistortionCoefficients = cv::Mat();
+	}
+	cv::Vec3d translationVector;
+	return cv::solvePnP(objectPoints, corners, usedCameraMatrix, usedDistortionCoefficients,
+		rotationVector, translationVector);
+}
+
+bool timur::CamCalibWi::detectPreview(const cv::Mat& frameGray,
+	std::vector<cv::Point2f>& foundPoints, std::vector<int>& foundIds) const
+{
+	// the decimated frame keeps detection at camera rate, points are scaled back
+	const double scale = std::min(1.0, static_cast<double>(previewWidth) / frameGray.cols);
+	cv::Mat previewGray = frameGray;
+	if (scale < 1.0)
+	{
+		cv::resize(frameGray, previewGray, cv::Size(), scale, scale, cv::INTER_AREA);
+	}
+
+	bool found = false;
+	switch (_pattern)
+	{
+	case Pattern::CHESSBOARD:
+		found = cv::findChessboardCorners(previewGray, _boardSize, foundPoints,
+			cv::CALIB_CB_ADAPTIVE_THRESH
+			+ cv::CALIB_CB_NORMALIZE_IMAGE
+			+ cv::CALIB_CB_FILTER_QUADS
+			+ cv::CALIB_CB_FAST_CHECK);
+		break;
+	case Pattern::CIRCLES_GRID:
+		found = cv::findCirclesGrid(previewGray, _boardSize, foundPoints);
+		break;
+	case Pattern::ASYMMETRIC_CIRCLES_GRID:
+		found = cv::findCirclesGrid(previewGray, _boardSize, foundPoints,
+			cv::CALIB_CB_ASYMMETRIC_GRID);
+		break;
+	case Pattern::CHARUCO:
+		// partially visible board is also found
+		found = findBoardCorners(previewGray, foundPoints, foundIds);
+		break;
+	}
+
+	if (found && scale < 1.0)
+	{
+		for (auto& point : foundPoints)
+		{
+			point.x = static_cast<float>((point.x + 0.5) / scale - 0.5);
+			point.y = static_cast<float>((point.y + 0.5) / scale - 0.5);
+		}
+	}
+	return found;
+}
+
+void timur::CamCalibWi::cameraCalibrationProcess(cv::VideoCapture& vid, const uint countOfFrames,
+	const bool autoSelection)
 {
 	if (!vid.isOpened() || _boardSize.empty())
 	{
 		return;
 	}
 
-	cv::Mat frame, frameGray;
-	std::vector<cv::Mat> savedImages;
+	cv::Mat frame;
 	std::vector<cv::Point2f> foundPoints;
+	std::vector<int> foundIds;
+	bool found = false;
+
+	FrameSelector selector(countOfFrames);
+	resetCalibrationWindow();
+
+	// preview detection runs on the worker, the loop only hands over the latest frame and takes
+	// the latest result, so a slow detection skips frames instead of slowing the preview down
+	std::mutex previewMutex;
+	std::condition_variable previewCondition;
+	cv::Mat pendingGray;
+	bool stopPreview = false;
+	cv::Mat resultGray;
+	std::vector<cv::Point2f> resultPoints;
+	std::vector<int> resultIds;
+	bool resultFound = false;
+	uint countOfResults = 0;
+	std::thread previewWorker([&]()
+	{
+		while (true)
+		{
+			cv::Mat frameGray;
+			{
+				std::unique_lock<std::mutex> lock(previewMutex);
+				previewCondition.wait(lock, [&]() { return stopPreview || !pendingGray.empty(); });
+				if (stopPreview)
+				{
+					return;
+				}
+				frameGray = pendingGray;
+				pendingGray = cv::Mat();
+			}
+			std::vector<cv::Point2f> points;
+			std::vector<int> ids;
+			bool foundOnFrame = false;
+			try
+			{
+				foundOnFrame = detectPreview(frameGray, points, ids);
+			}
+			catch (const cv::Exception& exception)
+			{
+				// an exception must not leave the thread, the frame is shown as not found
+				std::cout << "Preview detection failed: " << exception.what() << '\n';
+			}
+			{
+				std::lock_guard<std::mutex> lock(previewMutex);
+				resultGray = frameGray;
+				resultPoints.swap(points);
+				resultIds.swap(ids);
+				resultFound = foundOnFrame;
+				++countOfResults;
+			}
+		}
+	});
+	const WorkerGuard previewGuard(previewWorker, [&]()
+	{
+		{
+			std::lock_guard<std::mutex> lock(previewMutex);
+			stopPreview = true;
+		}
+		previewCondition.notify_one();
+	});
+
+	// incremental calibration runs on its own worker and every accepted frame is queued, so the
+	// solve does not stop the preview; the loop reads the intrinsics only from the copies handed
+	// back after every solve
+	std::mutex calibrationMutex;
+	std::condition_variable calibrationCondition;
+	std::deque<cv::Mat> pendingCalibration;
+	bool stopCalibration = false;
+	bool calibrationSaved = false;
+	cv::Mat solvedCameraMatrix = _cameraMatrix.clone();
+	cv::Mat solvedDistortionCoefficients = _distortionCoefficients.clone();
+	std::thread calibrationWorker([&]()
+	{
+		uint countOfGoodFrames = 0;
+		while (true)
+		{
+			cv::Mat frameGray;
+			{
+				std::unique_lock<std::mutex> lock(calibrationMutex);
+				calibrationCondition.wait(lock,
+					[&]() { return stopCalibration || !pendingCalibration.empty(); });
+				if (stopCalibration)
+				{
+					return;
+				}
+				frameGray = pendingCalibration.front();
+				pendingCalibration.pop_front();
+			}
+			// full resolution detection with cornerSubPix only on the accepted frame; in manual
+			// mode the window holds all frames, so the last update is the full calibration
+			double rms = -1.0;
+			try
+			{
+				rms = addCalibrationImage(frameGray, countOfFrames);
+			}
+			catch (const cv::Exception& exception)
+			{
+				std::cout << "Calibration update failed: " << exception.what() << '\n';
+			}
+			if (rms < 0.0)
+			{
+				continue;
+			}
+			++countOfGoodFrames;
+			if (!autoSelection)
+			{
+				std::cout << countOfGoodFrames << '/' << countOfFrames << ' ';
+			}
+			if (rms > 0.0)
+			{
+				std::cout << "RMS: " << rms << '\n';
+			}
+			else
+			{
+				std::cout << "Waiting for more frames to calibrate.." << '\n';
+			}
+			{
+				std::lock_guard<std::mutex> lock(calibrationMutex);
+				solvedCameraMatrix = _cameraMatrix.clone();
+				solvedDistortionCoefficients = _distortionCoefficients.clone();
+			}
+			if (!autoSelection && countOfGoodFrames >= countOfFrames)
+			{
+				std::cout << "Saving calibration parametrs.." << '\n';
+				saveCameraCalibration("CamCalib.bin");
+				std::cout << "Saved!" << '\n';
+				std::lock_guard<std::mutex> lock(calibrationMutex);
+				calibrationSaved = true;
+				return;
+			}
+		}
+	});
+	const auto queueCalibration = [&](const cv::Mat& frameGray)
+	{
+		{
+			std::lock_guard<std::mutex> lock(calibrationMutex);
+			pendingCalibration.push_back(frameGray);
+		}
+		calibrationCondition.notify_one();
+	};
+	const auto stopCalibrationWorker = [&]()
+	{
+		{
+			std::lock_guard<std::mutex> lock(calibrationMutex);
+			stopCalibration = true;
+		}
+		calibrationCondition.notify_one();
+		if (calibrationWorker.joinable())
+		{
+			calibrationWorker.join();
+		}
+	};
+	const WorkerGuard calibrationGuard(calibrationWorker, stopCalibrationWorker);
 
 	cv::namedWindow("Webcam", CV_WINDOW_AUTOSIZE);
-	uint countOfGoodFrames = 0;
+	uint countOfHandledResults = 0;
 	while (true)
 	{
+		cv::Mat cameraMatrix, distortionCoefficients;
+		{
+			std::lock_guard<std::mutex> lock(calibrationMutex);
+			if (calibrationSaved)
+			{
+				break;
+			}
+			cameraMatrix = solvedCameraMatrix;
+			distortionCoefficients = solvedDistortionCoefficients;
+		}
 		if (!vid.read(frame))
 		{
 			break;
 		}
+		cv::Mat frameGray;
 		cv::cvtColor(frame, frameGray, CV_BGR2GRAY);
-		bool found = false;
-		switch (_pattern)
-		{
-		case Pattern::CHESSBOARD:
-			found = cv::findChessboardCorners(frameGray, _boardSize, foundPoints,
-				cv::CALIB_CB_ADAPTIVE_THRESH
-				+ cv::CALIB_CB_NORMALIZE_IMAGE
-				+ cv::CALIB_CB_FILTER_QUADS
-				+ cv::CALIB_CB_FAST_CHECK);
-			break;
-		case Pattern::CIRCLES_GRID:
-			found = cv::findCirclesGrid(frameGray, _boardSize, foundPoints);
-			break;
-		case Pattern::ASYMMETRIC_CIRCLES_GRID:
-			found = cv::findCirclesGrid(frameGray, _boardSize, foundPoints,
-				cv::CALIB_CB_ASYMMETRIC_GRID);
-			break;
+
+		cv::Mat detectedGray;
+		{
+			std::lock_guard<std::mutex> lock(previewMutex);
+			pendingGray = frameGray;
+			if (countOfResults != countOfHandledResults)
+			{
+				countOfHandledResults = countOfResults;
+				detectedGray = resultGray;
+				foundPoints = resultPoints;
+				foundIds = resultIds;
+				found = resultFound;
+			}
+		}
+		previewCondition.notify_one();
+
+		if (found && autoSelection && !detectedGray.empty())
+		{
+			cv::Vec3d rotationVector;
+			if (estimateBoardRotation(foundPoints, foundIds, detectedGray.size(), cameraMatrix,
+					distortionCoefficients, rotationVector)
+				&& selector.offer(detectedGray, calcBlurriness(detectedGray), foundPoints,
+					rotationVector))
+			{
+				std::cout << selector.size() << '/' << countOfFrames << " regions: "
+					<< selector.coveredRegions() << " tilts: " << selector.coveredTilts() << '\n';
+				queueCalibration(detectedGray);
+			}
+			if (selector.isComplete())
+			{
+				// the incremental solve is not needed anymore and must not write the intrinsics
+				// during the full calibration
+				stopCalibrationWorker();
+				calibrateAndSave(selector.frames());
+				break;
+			}
 		}
 		if (found)
 		{
 			cv::Mat frameToDraw(frame.clone());
-			cv::drawChessboardCorners(frameToDraw, _boardSize, cv::Mat(foundPoints), found);
+			if (_pattern == Pattern::CHARUCO)
+			{
+				cv::aruco::drawDetectedCornersCharuco(frameToDraw, foundPoints, foundIds);
+			}
+			else
+			{
+				cv::drawChessboardCorners(frameToDraw, _boardSize, cv::Mat(foundPoints), found);
+			}
 			cv::imshow("Webcam", frameToDraw);
-			if (cv::waitKey(1) == ' ')
-			{
-				++countOfGoodFrames;
-				cv::Mat temp;
-				frameGray.copyTo(temp);
-				savedImages.push_back(temp);
-				std::cout << countOfGoodFrames << '/' << countOfFrames << '\n';
-				if (savedImages.size() >= countOfFrames)
-				{
-					std::cout << "Started calibration.." << '\n';
-					calculateIntrinsicParameters(savedImages);
-					std::cout << "Saving calibration parametrs.." << '\n';
-					saveCameraCalibration("CamCalib.txt");
-					std::cout << "Saved!" << '\n';
-					break;
-				}
+			const int key = cv::waitKey(1);
+			if (key == 27 && autoSelection)
+			{
+				break;
+			}
+			if (key == ' ' && !autoSelection)
+			{
+				queueCalibration(frameGray);
 			}
 		}
 		else
@@ -215,6 +780,7 @@ void timur::CamCalibWi::cameraCalibrationProcess(cv::VideoCapture& vid, const ui
 			}
 		}
 	}
+
 	cv::destroyWindow("Webcam");
 }
 
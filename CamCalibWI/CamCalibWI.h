@@ -1,9 +1,14 @@
 #ifndef CAMERA_CALIBRATION_2017_WITH_INTERFACE
 #define CAMERA_CALIBRATION_2017_WITH_INTERFACE
 
+#include <memory>
+#include <string>
+
 #include <opencv2/highgui/highgui.hpp>
 
 #include <CameraCalibration.h>
+#include "FocusMeter.h"
+#include "FrameSelector.h"
 
 namespace timur
 {
@@ -11,19 +16,88 @@ class CamCalibWi : private CameraCalibration
 {
 private:
     /**
-    * \brief Saving camera calibration parameters in file.
+    * \brief Precomputed maps of cv::remap for undistortion of images of _imageSize.
+    */
+    cv::Mat _undistortMap1, _undistortMap2;
+
+    /**
+    * \brief Mapped calibration file holding the data of the maps, kept while the maps are used.
+    */
+    std::shared_ptr<const char> _mappedCalibration;
+
+    /**
+    * \brief Saving camera calibration parameters in versioned binary file: intrinsics,
+    * distortion, image size and optionally the undistortion maps.
     * \param[in] name Name of file to save.
+    * \param[in] withMaps If true, undistortion maps are precomputed and saved.
+    * \return True, if the calibration was saved, and false, if not.
     */
-    void saveCameraCalibration(const std::string& name) const;
+    bool saveCameraCalibration(const std::string& name, const bool withMaps = true) const;
 
     /**
-    * \brief Download camera calibration parameters from file.
+    * \brief Download camera calibration parameters from binary file or from legacy text file.
     * \param[in] name File name for download.
     */
     void loadCameraCalibration(const std::string& name);
 
     /**
-    * \brief Calculates image blurriness.
+    * \brief Download camera calibration from memory-mapped binary file, the maps are used in
+    * place without reading them.
+    * \param[in] name File name for download.
+    * \return True, if the calibration was loaded, and false, if not.
+    */
+    bool loadBinaryCalibration(const std::string& name);
+
+    /**
+    * \brief Download camera calibration from legacy text file (rows, columns and values of the
+    * camera matrix, then of the distortion coefficients).
+    * \param[in] name File name for download.
+    * \return True, if the calibration was loaded, and false, if not.
+    */
+    bool loadLegacyCalibration(const std::string& name);
+
+    /**
+    * \brief Printing progress of the corners detection.
+    * \param[in] countOfProcessed Count of processed images.
+    * \param[in] countOfImages Count of all images.
+    */
+    static void printProgress(const size_t countOfProcessed, const size_t countOfImages);
+
+    /**
+    * \brief Calibrating the camera on the frames and saving calibration in CamCalib.bin.
+    * \param[in] images Greyscale frames with chessboard/circle grid.
+    */
+    void calibrateAndSave(const std::vector<cv::Mat>& images);
+
+    /**
+    * \brief Estimating board rotation relative to the camera. Before calibration the camera
+    * matrix is guessed from the image size.
+    * \param[in] corners Found board points.
+    * \param[in] ids Identifiers of the found points, empty if all points are found.
+    * \param[in] imageSize Size of the frame.
+    * \param[in] cameraMatrix Current camera matrix, empty before calibration.
+    * \param[in] distortionCoefficients Current distortion coefficients.
+    * \param[out] rotationVector Board rotation relative to the camera.
+    * \return True, if the rotation was estimated, and false, if not.
+    */
+    bool estimateBoardRotation(const std::vector<cv::Point2f>& corners,
+                               const std::vector<int>& ids, const cv::Size imageSize,
+                               const cv::Mat& cameraMatrix, const cv::Mat& distortionCoefficients,
+                               cv::Vec3d& rotationVector) const;
+
+    /**
+    * \brief Fast detection of the pattern for preview on the frame decimated to 640 pixels width.
+    * \param[in] frameGray Greyscale frame.
+    * \param[out] foundPoints Found points in the coordinates of the full frame.
+    * \param[out] foundIds Identifiers of the found charuco corners, empty for other patterns.
+    * \return True, if the pattern was found, and false, if not.
+    */
+    bool detectPreview(const cv::Mat& frameGray, std::vector<cv::Point2f>& foundPoints,
+                       std::vector<int>& foundIds) const;
+
+    /**
+    * \brief Calculates image blurriness from the gradient energy of the half-size image, cheap
+    * enough to gate every frame.
     * \param[in] src Input image.
     * \return Rate of blurriness.
     */
@@ -32,11 +106,17 @@ private:
 public:
     /**
     * \brief CamCalibWi constructor.
-    * \param[in] boardDimension Dimension of chessboard(the intersection of cells).
+    * \param[in] boardDimension Dimension of chessboard(the intersection of cells),
+    * number of squares for charuco board.
     * \param[in] patternCode Code of using pattern.
-    * (chessboard = 0, circlesGrid = 1, asymmetricCirclesGrid = 2). 
+    * (chessboard = 0, circlesGrid = 1, asymmetricCirclesGrid = 2, charuco = 3). 
+    * \param[in] squareLength Length of the charuco board square.
+    * \param[in] markerLength Length of the charuco board marker side (less than squareLength).
+    * \param[in] charucoDictionaryId Identifier of the predefined dictionary of charuco markers.
     */
-    CamCalibWi(const cv::Size boardDimension, const uint patternCode);
+    CamCalibWi(const cv::Size boardDimension, const uint patternCode,
+               const float squareLength = 1.0f, const float markerLength = 0.5f,
+               const int charucoDictionaryId = cv::aruco::DICT_4X4_50);
 
     /**
     * \brief CamCalibWi constructor.
@@ -48,6 +128,7 @@ public:
 
     /**
     * \brief Download images from file and calibrate camera. (image name: i.png, i = 0,countOfImages)
+    * Found corners are cached in folderName.corners, so unchanged images are not detected again.
     * \param[in] folderName File name for download images.
     * \param[in] countOfImages Count of images.
     */
@@ -56,9 +137,17 @@ public:
     /**
     * \brief Starting camera calibration.
     * \param[in] vid Opencv camera object initialized with needed camera.
-    * \param[in] countOfFrames Count of images for calibration.
+    * \param[in] countOfFrames Count of images for calibration (maximum count with automatic
+    * selection).
+    * \param[in] autoSelection If true, frames are selected without pressing space by sharpness
+    * and by coverage of image regions and board tilts, calibration starts once they are covered
+    * (see FrameSelector).
+    * Intrinsics are refined after every accepted frame from the third one on a worker thread
+    * and the reprojection error is printed. The preview is detected on a decimated frame on
+    * another worker thread, accepted frames are detected again in full resolution.
     */
-    void cameraCalibrationProcess(cv::VideoCapture& vid, const uint countOfFrames);
+    void cameraCalibrationProcess(cv::VideoCapture& vid, const uint countOfFrames,
+                                  const bool autoSelection = false);
 
     /**
     * \brief Returning property of _cameraMatrix.
@@ -74,16 +163,19 @@ public:
 
     /**
     * \brief Transforms an image to compensate for lens distortion.
+    * Precomputed maps of the calibration file are used for images of the calibrated size.
     * \param[in] inputImage Input image.
     * \return Output image without distortion.
     */
     cv::Mat undistort(cv::Mat& inputImage) const;
 
     /**
-    * \brief Helps adjust the camera's manual focus.
+    * \brief Helps adjust the camera's manual focus. Shows the focus metric with its minimum and
+    * peak, 'r' resets the range.
     * \param[in] vid Opencv camera object initialized with needed camera.
+    * \param[in] roi Region of the frame to focus on, empty for the whole frame.
     */
-    static void focusSetting(cv::VideoCapture& vid);
+    static void focusSetting(cv::VideoCapture& vid, const cv::Rect roi = cv::Rect());
 };
 }
 #endif //!CAMERA_CALIBRATION_2017_WITH_INTERFACE
@@ -0,0 +1,143 @@
+#include "FocusMeter.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include <opencv2/core/hal/intrin.hpp>
+#include <opencv2/imgproc.hpp>
+
+timur::FocusMeter::FocusMeter(const cv::Rect roi, const int decimation)
+	: _roi(roi),
+	  _decimation(std::max(decimation, 1)),
+	  _stop(false),
+	  _reading{0.0, 0.0, 0.0, 0},
+	  _worker(&FocusMeter::run, this)
+{
+}
+
+timur::FocusMeter::~FocusMeter()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_condition.notify_one();
+	_worker.join();
+}
+
+void timur::FocusMeter::run()
+{
+	while (true)
+	{
+		cv::Mat frame;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_condition.wait(lock, [this]() { return _stop || !_pendingFrame.empty(); });
+			if (_stop)
+			{
+				return;
+			}
+			frame = _pendingFrame;
+			_pendingFrame = cv::Mat();
+		}
+
+		// the region of interest was cut out on submit
+		const double value = gradientEnergy(frame, cv::Rect(), _decimation);
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_reading.value = value;
+			_reading.minimum = _reading.countOfFrames == 0 ? value : std::min(_reading.minimum, value);
+			_reading.maximum = _reading.countOfFrames == 0 ? value : std::max(_reading.maximum, value);
+			++_reading.countOfFrames;
+		}
+	}
+}
+
+void timur::FocusMeter::submit(const cv::Mat& frame)
+{
+	if (frame.empty())
+	{
+		return;
+	}
+	const cv::Rect roi = _roi.area() > 0 ? _roi & cv::Rect(0, 0, frame.cols, frame.rows)
+		: cv::Rect(0, 0, frame.cols, frame.rows);
+	if (roi.area() == 0)
+	{
+		return;
+	}
+	const cv::Mat region = frame(roi).clone();
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_pendingFrame = region;
+	}
+	_condition.notify_one();
+}
+
+timur::FocusMeter::Reading timur::FocusMeter::reading() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _reading;
+}
+
+void timur::FocusMeter::resetRange()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_reading.minimum = _reading.value;
+	_reading.maximum = _reading.value;
+}
+
+double timur::FocusMeter::gradientEnergy(const cv::Mat& image, const cv::Rect roi,
+	const int decimation)
+{
+	if (image.empty())
+	{
+		return 0.0;
+	}
+	cv::Mat region = roi.area() > 0 ? image(roi & cv::Rect(0, 0, image.cols, image.rows)) : image;
+	if (decimation > 1)
+	{
+		cv::resize(region, region, cv::Size(), 1.0 / decimation, 1.0 / decimation,
+			cv::INTER_AREA);
+	}
+	cv::Mat gray = region;
+	if (region.channels() != 1)
+	{
+		cv::cvtColor(region, gray, CV_BGR2GRAY);
+	}
+	if (gray.depth() != CV_8U || gray.rows < 2 || gray.cols < 2)
+	{
+		return 0.0;
+	}
+
+	// forward differences with the right and the bottom neighbour in 16-bit lanes, squared and
+	// summed pairwise into 32-bit lanes, every row is flushed to 64 bits
+	std::uint64_t energy = 0;
+	for (int y = 0; y < gray.rows - 1; ++y)
+	{
+		const uchar* row = gray.ptr<uchar>(y);
+		const uchar* nextRow = gray.ptr<uchar>(y + 1);
+		std::int64_t rowEnergy = 0;
+		int x = 0;
+#if CV_SIMD128
+		cv::v_int32x4 sum = cv::v_setzero_s32();
+		for (; x <= gray.cols - 9; x += 8)
+		{
+			const cv::v_int16x8 centre = cv::v_reinterpret_as_s16(cv::v_load_expand(row + x));
+			const cv::v_int16x8 right = cv::v_reinterpret_as_s16(cv::v_load_expand(row + x + 1));
+			const cv::v_int16x8 bottom = cv::v_reinterpret_as_s16(cv::v_load_expand(nextRow + x));
+			const cv::v_int16x8 dx = right - centre;
+			const cv::v_int16x8 dy = bottom - centre;
+			sum += cv::v_dotprod(dx, dx) + cv::v_dotprod(dy, dy);
+		}
+		rowEnergy = cv::v_reduce_sum(sum);
+#endif
+		for (; x < gray.cols - 1; ++x)
+		{
+			const int dx = row[x + 1] - row[x];
+			const int dy = nextRow[x] - row[x];
+			rowEnergy += dx * dx + dy * dy;
+		}
+		energy += static_cast<std::uint64_t>(rowEnergy);
+	}
+	return static_cast<double>(energy) / (static_cast<double>(gray.rows - 1) * (gray.cols - 1));
+}
@@ -0,0 +1,127 @@
+/**
+* \file
+* \brief Header file with class description of the video-rate focus metric.
+*/
+#ifndef CAMERA_FOCUS_METER_2017
+#define CAMERA_FOCUS_METER_2017
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <opencv2/core.hpp>
+
+namespace timur
+{
+/**
+ * \brief Focus metric computed on its own thread. The metric is the mean integer gradient
+ * energy (dx^2 + dy^2 of neighbouring pixels) of a region of interest of the decimated frame,
+ * larger is sharper.
+ */
+class FocusMeter
+{
+public:
+    /**
+     * \brief Latest value of the metric and its range over the frames since the last reset.
+     */
+    struct Reading
+    {
+        double value;
+        double minimum;
+        double maximum;
+        uint countOfFrames;
+    };
+
+private:
+    /**
+     * \brief Region of interest in the frame, empty for the whole frame.
+     */
+    const cv::Rect _roi;
+
+    /**
+     * \brief Factor of the frame decimation before the metric.
+     */
+    const int _decimation;
+
+    /**
+     * \brief Guards the pending frame, the reading and the stop flag.
+     */
+    mutable std::mutex _mutex;
+
+    /**
+     * \brief Wakes the worker when a frame is submitted or the meter is destroyed.
+     */
+    std::condition_variable _condition;
+
+    /**
+     * \brief Latest submitted frame waiting for the worker.
+     */
+    cv::Mat _pendingFrame;
+
+    /**
+     * \brief True when the worker has to finish.
+     */
+    bool _stop;
+
+    /**
+     * \brief Latest reading.
+     */
+    Reading _reading;
+
+    /**
+     * \brief Worker thread computing the metric.
+     */
+    std::thread _worker;
+
+    /**
+     * \brief Loop of the worker thread.
+     */
+    void run();
+
+public:
+    /**
+     * \brief FocusMeter constructor, starting the worker thread.
+     * \param[in] roi Region of interest in the frame, empty for the whole frame.
+     * \param[in] decimation Factor of the frame decimation before the metric.
+     */
+    explicit FocusMeter(const cv::Rect roi = cv::Rect(), const int decimation = 2);
+
+    /**
+     * \brief FocusMeter destructor, stopping the worker thread.
+     */
+    virtual ~FocusMeter();
+
+    FocusMeter(const FocusMeter&) = delete;
+    FocusMeter& operator=(const FocusMeter&) = delete;
+
+    /**
+     * \brief Submitting a frame to the worker. The region of interest is copied, so the frame
+     * can be drawn on afterwards. A frame still waiting for the worker is replaced.
+     * \param[in] frame Greyscale or BGR frame.
+     */
+    void submit(const cv::Mat& frame);
+
+    /**
+     * \brief Returning the latest reading.
+     * \return Latest value of the metric and its range.
+     */
+    Reading reading() const;
+
+    /**
+     * \brief Forgetting the range of the metric, e.g. after moving the camera to another scene.
+     */
+    void resetRange();
+
+    /**
+     * \brief Calculating the metric synchronously, cheap enough for a per-frame blur gate.
+     * \param[in] image Greyscale or BGR image.
+     * \param[in] roi Region of interest in the image, empty for the whole image.
+     * \param[in] decimation Factor of the image decimation before the metric.
+     * \return Mean gradient energy per pixel, larger is sharper.
+     */
+    static double gradientEnergy(const cv::Mat& image, const cv::Rect roi = cv::Rect(),
+                                 const int decimation = 1);
+};
+}
+
+#endif //!CAMERA_FOCUS_METER_2017
@@ -0,0 +1,168 @@
+#include "FrameSelector.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <opencv2/calib3d.hpp>
+
+timur::FrameSelector::FrameSelector(const size_t maxFrames, const double minTiltAngle)
+	: _maxFrames(maxFrames),
+	  _minTiltAngle(minTiltAngle)
+{
+}
+
+void timur::FrameSelector::countCoverage(
+	std::array<int, _regionsPerSide * _regionsPerSide>& regionCounts,
+	std::array<int, _countOfTilts>& tiltCounts) const
+{
+	regionCounts.fill(0);
+	tiltCounts.fill(0);
+	for (const auto& classAndFrame : _frames)
+	{
+		++regionCounts[classAndFrame.first.first];
+		++tiltCounts[classAndFrame.first.second];
+	}
+}
+
+int timur::FrameSelector::coverage(
+	const std::array<int, _regionsPerSide * _regionsPerSide>& regionCounts,
+	const std::array<int, _countOfTilts>& tiltCounts)
+{
+	const auto isCovered = [](const int count) { return count > 0; };
+	return static_cast<int>(std::count_if(regionCounts.begin(), regionCounts.end(), isCovered)
+		+ std::count_if(tiltCounts.begin(), tiltCounts.end(), isCovered));
+}
+
+bool timur::FrameSelector::offer(const cv::Mat& image, const float blurriness,
+	const std::vector<cv::Point2f>& corners, const cv::Vec3d& rotationVector)
+{
+	if (corners.empty() || _maxFrames == 0)
+	{
+		return false;
+	}
+
+	// region of the board centre
+	cv::Point2f centre(0.0f, 0.0f);
+	for (const auto& corner : corners)
+	{
+		centre += corner;
+	}
+	centre *= 1.0f / static_cast<float>(corners.size());
+	const int regionX = std::min(std::max(static_cast<int>(_regionsPerSide * centre.x
+		/ image.cols), 0), _regionsPerSide - 1);
+	const int regionY = std::min(std::max(static_cast<int>(_regionsPerSide * centre.y
+		/ image.rows), 0), _regionsPerSide - 1);
+	const int region = regionY * _regionsPerSide + regionX;
+
+	// tilt of the board normal from the optical axis and its dominant side
+	cv::Matx33d rotation;
+	cv::Rodrigues(rotationVector, rotation);
+	cv::Vec3d normal(rotation(0, 2), rotation(1, 2), rotation(2, 2));
+	if (normal[2] < 0.0)
+	{
+		normal = -normal;
+	}
+	const double tiltAngle = std::acos(std::min(normal[2], 1.0)) * 180.0 / CV_PI;
+	int tilt = 0;
+	if (tiltAngle >= _minTiltAngle)
+	{
+		tilt = std::abs(normal[0]) >= std::abs(normal[1])
+			? (normal[0] > 0.0 ? 1 : 2)
+			: (normal[1] > 0.0 ? 3 : 4);
+	}
+
+	const std::pair<int, int> frameClass(region, tilt);
+	const auto sameClass = _frames.find(frameClass);
+	if (sameClass != _frames.end())
+	{
+		// near-duplicate, only the sharper one is kept
+		if (blurriness >= sameClass->second.blurriness)
+		{
+			return false;
+		}
+		sameClass->second = SelectedFrame{image.clone(), blurriness};
+		return true;
+	}
+
+	if (_frames.size() >= _maxFrames)
+	{
+		// the frame whose replacement by the new one gives the most covered regions and tilts
+		// gives way, the blurriest one among equal coverage
+		std::array<int, _regionsPerSide * _regionsPerSide> regionCounts;
+		std::array<int, _countOfTilts> tiltCounts;
+		countCoverage(regionCounts, tiltCounts);
+		const int currentCoverage = coverage(regionCounts, tiltCounts);
+		auto replaced = _frames.end();
+		int bestCoverage = currentCoverage;
+		for (auto frame = _frames.begin(); frame != _frames.end(); ++frame)
+		{
+			auto swappedRegions = regionCounts;
+			auto swappedTilts = tiltCounts;
+			--swappedRegions[frame->first.first];
+			--swappedTilts[frame->first.second];
+			++swappedRegions[region];
+			++swappedTilts[tilt];
+			const int swappedCoverage = coverage(swappedRegions, swappedTilts);
+			if (swappedCoverage > bestCoverage
+				|| (swappedCoverage == bestCoverage && replaced != _frames.end()
+					&& frame->second.blurriness > replaced->second.blurriness))
+			{
+				replaced = frame;
+				bestCoverage = swappedCoverage;
+			}
+		}
+		// only a strict gain is accepted, so the frames can not replace each other endlessly
+		if (replaced == _frames.end())
+		{
+			return false;
+		}
+		_frames.erase(replaced);
+	}
+
+	_frames[frameClass] = SelectedFrame{image.clone(), blurriness};
+	return true;
+}
+
+size_t timur::FrameSelector::size() const
+{
+	return _frames.size();
+}
+
+int timur::FrameSelector::coveredRegions() const
+{
+	std::array<int, _regionsPerSide * _regionsPerSide> regionCounts;
+	std::array<int, _countOfTilts> tiltCounts;
+	countCoverage(regionCounts, tiltCounts);
+	return static_cast<int>(std::count_if(regionCounts.begin(), regionCounts.end(),
+		[](const int count) { return count > 0; }));
+}
+
+int timur::FrameSelector::coveredTilts() const
+{
+	std::array<int, _regionsPerSide * _regionsPerSide> regionCounts;
+	std::array<int, _countOfTilts> tiltCounts;
+	countCoverage(regionCounts, tiltCounts);
+	return static_cast<int>(std::count_if(tiltCounts.begin(), tiltCounts.end(),
+		[](const int count) { return count > 0; }));
+}
+
+bool timur::FrameSelector::isComplete() const
+{
+	// every frame covers one region and one tilt class, so a set smaller than the count of
+	// regions or tilts is complete when each of its frames covers another one
+	const size_t regionsToCover = std::min(_maxFrames,
+		static_cast<size_t>(_regionsPerSide * _regionsPerSide));
+	const size_t tiltsToCover = std::min(_maxFrames, static_cast<size_t>(_countOfTilts));
+	return static_cast<size_t>(coveredRegions()) >= regionsToCover
+		&& static_cast<size_t>(coveredTilts()) >= tiltsToCover;
+}
+
+std::vector<cv::Mat> timur::FrameSelector::frames() const
+{
+	std::vector<cv::Mat> images;
+	for (const auto& classAndFrame : _frames)
+	{
+		images.push_back(classAndFrame.second.image);
+	}
+	return images;
+}
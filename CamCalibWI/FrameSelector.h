@@ -0,0 +1,135 @@
+/**
+* \file
+* \brief Header file with class description of the automatic selection of calibration frames.
+*/
+#ifndef CALIBRATION_FRAME_SELECTOR_2017
+#define CALIBRATION_FRAME_SELECTOR_2017
+
+#include <array>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace timur
+{
+/**
+ * \brief Bounded set of calibration frames covering image regions and board tilts.
+ * Every frame is classified by the image region of the board centre (3x3 grid) and by the board
+ * tilt (frontal or tilted towards one of four sides). Only the sharpest frame of every class is
+ * kept, so near-duplicate frames replace each other instead of piling up.
+ */
+class FrameSelector
+{
+private:
+    /**
+     * \brief Frame kept by the selector.
+     */
+    struct SelectedFrame
+    {
+        cv::Mat image;
+        float blurriness;
+    };
+
+    /**
+     * \brief Count of image regions by width and height.
+     */
+    static const int _regionsPerSide = 3;
+
+    /**
+     * \brief Count of tilt classes (frontal, +x, -x, +y, -y).
+     */
+    static const int _countOfTilts = 5;
+
+    /**
+     * \brief Maximum count of kept frames.
+     */
+    const size_t _maxFrames;
+
+    /**
+     * \brief Minimum angle in degrees between board normal and optical axis of tilted board.
+     */
+    const double _minTiltAngle;
+
+    /**
+     * \brief Kept frames by region and tilt class.
+     */
+    std::map<std::pair<int, int>, SelectedFrame> _frames;
+
+    /**
+     * \brief Counting kept frames of every region and of every tilt class.
+     * \param[out] regionCounts Count of frames of every region.
+     * \param[out] tiltCounts Count of frames of every tilt class.
+     */
+    void countCoverage(std::array<int, _regionsPerSide * _regionsPerSide>& regionCounts,
+                       std::array<int, _countOfTilts>& tiltCounts) const;
+
+    /**
+     * \brief Counting covered regions and tilt classes together.
+     * \param[in] regionCounts Count of frames of every region.
+     * \param[in] tiltCounts Count of frames of every tilt class.
+     * \return Count of regions and tilt classes with at least one frame.
+     */
+    static int coverage(const std::array<int, _regionsPerSide * _regionsPerSide>& regionCounts,
+                        const std::array<int, _countOfTilts>& tiltCounts);
+
+public:
+    /**
+     * \brief FrameSelector constructor.
+     * \param[in] maxFrames Maximum count of kept frames.
+     * \param[in] minTiltAngle Minimum angle in degrees between board normal and optical axis of
+     * tilted board.
+     */
+    explicit FrameSelector(const size_t maxFrames, const double minTiltAngle = 15.0);
+
+    /**
+     * \brief FrameSelector destructor.
+     */
+    virtual ~FrameSelector() = default;
+
+    /**
+     * \brief Offering a frame with found board to the selector.
+     * \param[in] image Frame, it is cloned if the frame is kept.
+     * \param[in] blurriness Rate of blurriness of the frame (less is sharper).
+     * \param[in] corners Found board points on the frame.
+     * \param[in] rotationVector Board rotation relative to the camera.
+     * \return True, if the frame was kept, and false, if not.
+     */
+    bool offer(const cv::Mat& image, const float blurriness,
+               const std::vector<cv::Point2f>& corners, const cv::Vec3d& rotationVector);
+
+    /**
+     * \brief Returning count of kept frames.
+     * \return Count of kept frames.
+     */
+    size_t size() const;
+
+    /**
+     * \brief Returning count of covered image regions.
+     * \return Count of regions with at least one kept frame.
+     */
+    int coveredRegions() const;
+
+    /**
+     * \brief Returning count of covered tilt classes.
+     * \return Count of tilt classes with at least one kept frame.
+     */
+    int coveredTilts() const;
+
+    /**
+     * \brief Checking if the kept frames cover every region and tilt class, or as many of them as
+     * maxFrames frames can cover.
+     * \return True, if the selection is complete, and false, if not.
+     */
+    bool isComplete() const;
+
+    /**
+     * \brief Returning kept frames.
+     * \return Kept frames ordered by region and tilt class.
+     */
+    std::vector<cv::Mat> frames() const;
+};
+}
+
+#endif //!CALIBRATION_FRAME_SELECTOR_2017
@@ -1,8 +1,149 @@
 #include "CameraCalibration.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
 #include <opencv2/calib3d/calib3d.hpp>
+#include <opencv2/core/utility.hpp>
+#include <opencv2/imgcodecs.hpp>
 #include <opencv2/shape/hist_cost.hpp>
 #include <vector>
 
+namespace
+{
+/**
+ * \brief Flags of chessboard detection.
+ */
+const int chessboardFlags = cv::CALIB_CB_ADAPTIVE_THRESH + cv::CALIB_CB_NORMALIZE_IMAGE
+                            + cv::CALIB_CB_FILTER_QUADS;
+
+/**
+ * \brief Half of the side of the search window of chessboard corners refinement.
+ */
+const cv::Size subPixWindowSize(11, 11);
+
+/**
+ * \brief Termination criteria of chessboard corners refinement.
+ */
+const cv::TermCriteria subPixCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 50, 0.001);
+
+/**
+ * \brief Minimum count of interpolated charuco corners to use the image for calibration.
+ */
+const int minCharucoCorners = 4;
+
+/**
+ * \brief Minimum spread of the charuco corners across their main direction on the board, as a
+ * rate of the square length.
+ */
+const double minCharucoSpreadRate = 0.1;
+
+/**
+ * \brief Checking that the charuco corners are not collinear on the board (a row, a column or a
+ * diagonal), such corners give no homography of the board. The standard deviation of the board
+ * points along their minor axis must be at least minCharucoSpreadRate of the square.
+ * \param[in] boardCorners Chessboard corners of the charuco board.
+ * \param[in] ids Identifiers of the chessboard corners.
+ * \param[in] squareLength Length of the charuco board square.
+ */
+bool spansBoardPlane(const std::vector<cv::Point3f>& boardCorners, const std::vector<int>& ids,
+                     const float squareLength)
+{
+    if (ids.empty())
+    {
+        return false;
+    }
+    double meanX = 0.0;
+    double meanY = 0.0;
+    for (const int id : ids)
+    {
+        meanX += boardCorners[id].x;
+        meanY += boardCorners[id].y;
+    }
+    meanX /= ids.size();
+    meanY /= ids.size();
+    double covXX = 0.0;
+    double covXY = 0.0;
+    double covYY = 0.0;
+    for (const int id : ids)
+    {
+        const double dx = boardCorners[id].x - meanX;
+        const double dy = boardCorners[id].y - meanY;
+        covXX += dx * dx;
+        covXY += dx * dy;
+        covYY += dy * dy;
+    }
+    covXX /= ids.size();
+    covXY /= ids.size();
+    covYY /= ids.size();
+    // smaller eigenvalue of the covariance matrix of the board points
+    const double halfDifference = (covXX - covYY) / 2.0;
+    const double minEigenvalue = (covXX + covYY) / 2.0
+                                 - std::sqrt(halfDifference * halfDifference + covXY * covXY);
+    const double minSpread = minCharucoSpreadRate * squareLength;
+    return minEigenvalue >= minSpread * minSpread;
+}
+
+/**
+ * \brief Termination criteria of the incremental calibration updates, which start from the current
+ * intrinsics: a few iterations, instead of the 30 of cv::calibrateCamera.
+ */
+const cv::TermCriteria incrementalCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 5,
+                                           1e-6);
+
+/**
+ * \brief Minimum count of frames in the window of incremental calibration before the first solve,
+ * one view does not determine focal lengths, principal point and distortion together.
+ */
+const size_t minCalibrationWindow = 3;
+
+/**
+ * \brief First bytes of a corner cache file.
+ */
+const char cornerCacheSignature[4] = {'C', 'C', 'R', 'N'};
+
+/**
+ * \brief Version of the corner cache file format.
+ */
+const std::uint32_t cornerCacheVersion = 3;
+
+/**
+ * \brief 64-bit FNV-1a hash of the bytes.
+ */
+std::uint64_t contentHash(const std::vector<uchar>& bytes)
+{
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (const uchar byte : bytes)
+    {
+        hash ^= byte;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * \brief Writing a value of trivial type to the binary stream.
+ */
+template <typename T>
+void writeValue(std::ostream& stream, const T& value)
+{
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+/**
+ * \brief Reading a value of trivial type from the binary stream.
+ */
+template <typename T>
+void readValue(std::istream& stream, T& value)
+{
+    stream.read(reinterpret_cast<char*>(&value), sizeof(value));
+}
+}
+
 void timur::CameraCalibration::createKnownBoardPosition(std::vector<cv::Point3f>& corners) const
 {
     switch (_pattern)
@@ -29,77 +170,461 @@ void timur::CameraCalibration::createKnownBoardPosition(std::vector<cv::Point3f>
                 }
             }
             break;
+
+        case Pattern::CHARUCO:
+            for (const auto& corner : _charucoBoard->chessboardCorners)
+            {
+                corners.push_back(corner);
+            }
+            break;
     }
 }
 
-void timur::CameraCalibration::getBoardCorners(const std::vector<cv::Mat>& images,
-                                               std::vector<std::vector<cv::Point2f>>&
-                                               allFoundCorners) const
+bool timur::CameraCalibration::findBoardCorners(const cv::Mat& image,
+                                                std::vector<cv::Point2f>& corners,
+                                                std::vector<int>& ids) const
 {
+    bool found = false;
     switch (_pattern)
     {
         case Pattern::CHESSBOARD:
-            for (const auto image : images)
+            found = cv::findChessboardCorners(image, _boardSize, corners, chessboardFlags);
+            if (found)
             {
-                std::vector<cv::Point2f> pointBuf;
-                const bool found = cv::findChessboardCorners(image, _boardSize, pointBuf,
-                                                             cv::CALIB_CB_ADAPTIVE_THRESH
-                                                             + cv::CALIB_CB_NORMALIZE_IMAGE
-                                                             + cv::CALIB_CB_FILTER_QUADS);
-                if (found)
-                {
-                    cv::cornerSubPix(image, pointBuf, cv::Size(11, 11), cv::Size(-1, -1),
-                                     cv::TermCriteria(cv::TermCriteria::EPS
-                                                      + cv::TermCriteria::COUNT, 50, 0.001));
-                    allFoundCorners.push_back(pointBuf);
-                }
+                cv::cornerSubPix(image, corners, subPixWindowSize, cv::Size(-1, -1),
+                                 subPixCriteria);
             }
             break;
         case Pattern::CIRCLES_GRID:
-            for (const auto image : images)
+            found = cv::findCirclesGrid(image, _boardSize, corners);
+            break;
+        case Pattern::ASYMMETRIC_CIRCLES_GRID:
+            found = cv::findCirclesGrid(image, _boardSize, corners, cv::CALIB_CB_ASYMMETRIC_GRID);
+            break;
+        case Pattern::CHARUCO:
+        {
+            std::vector<std::vector<cv::Point2f>> markerCorners;
+            std::vector<int> markerIds;
+            cv::aruco::detectMarkers(image, _charucoBoard->dictionary, markerCorners, markerIds,
+                                     _charucoDetectorParameters);
+            if (!markerIds.empty())
             {
-                std::vector<cv::Point2f> pointBuf;
-                const bool found = findCirclesGrid(image, _boardSize, pointBuf);
-                if (found)
-                {
-                    allFoundCorners.push_back(pointBuf);
-                }
+                // corners between found markers are refined with cornerSubPix inside
+                found = cv::aruco::interpolateCornersCharuco(markerCorners, markerIds, image,
+                                                             _charucoBoard, corners, ids)
+                        >= minCharucoCorners
+                        && spansBoardPlane(_charucoBoard->chessboardCorners, ids,
+                                           _charucoBoard->getSquareLength());
             }
             break;
-        case Pattern::ASYMMETRIC_CIRCLES_GRID:
-            for (const auto image : images)
+        }
+    }
+    return found;
+}
+
+void timur::CameraCalibration::getBoardCornersParallel(
+    const size_t countOfImages,
+    const std::function<bool(size_t, std::vector<cv::Point2f>&, std::vector<int>&, cv::Size&)>&
+    detectOnImage,
+    std::vector<std::vector<cv::Point2f>>& allFoundCorners,
+    std::vector<std::vector<int>>& allFoundIds, cv::Size& imageSize,
+    const std::function<void(size_t, size_t)>& progress) const
+{
+    // every image writes only its own slot, so the order does not depend on the scheduling
+    std::vector<std::vector<cv::Point2f>> cornersOfImages(countOfImages);
+    std::vector<std::vector<int>> idsOfImages(countOfImages);
+    std::vector<cv::Size> sizesOfImages(countOfImages);
+    std::vector<uchar> foundOnImages(countOfImages, 0);
+    std::atomic<size_t> countOfProcessed(0);
+    std::mutex progressMutex;
+
+    cv::parallel_for_(cv::Range(0, static_cast<int>(countOfImages)), [&](const cv::Range& range)
+    {
+        for (int i = range.start; i < range.end; ++i)
+        {
+            foundOnImages[i] =
+                detectOnImage(i, cornersOfImages[i], idsOfImages[i], sizesOfImages[i]) ? 1 : 0;
+            const size_t processed = ++countOfProcessed;
+            if (progress)
             {
-                std::vector<cv::Point2f> pointBuf;
-                const bool found = findCirclesGrid(image, _boardSize, pointBuf,
-                                                   cv::CALIB_CB_ASYMMETRIC_GRID);
-                if (found)
+                std::lock_guard<std::mutex> lock(progressMutex);
+                progress(processed, countOfImages);
+            }
+        }
+    });
+
+    for (size_t i = 0; i < countOfImages; ++i)
+    {
+        if (foundOnImages[i])
+        {
+            if (imageSize.empty())
+            {
+                imageSize = sizesOfImages[i];
+            }
+            allFoundCorners.push_back(std::move(cornersOfImages[i]));
+            allFoundIds.push_back(std::move(idsOfImages[i]));
+        }
+    }
+}
+
+void timur::CameraCalibration::getBoardCorners(const std::vector<cv::Mat>& images,
+                                               std::vector<std::vector<cv::Point2f>>&
+                                               allFoundCorners,
+                                               std::vector<std::vector<int>>& allFoundIds,
+                                               cv::Size& imageSize,
+                                               const std::function<void(size_t, size_t)>&
+                                               progress) const
+{
+    getBoardCornersParallel(images.size(),
+                            [&](const size_t i, std::vector<cv::Point2f>& corners,
+                                std::vector<int>& ids, cv::Size& size)
+                            {
+                                size = images[i].size();
+                                return findBoardCorners(images[i], corners, ids);
+                            },
+                            allFoundCorners, allFoundIds, imageSize, progress);
+}
+
+void timur::CameraCalibration::getBoardCornersFromFiles(const std::vector<std::string>& fileNames,
+                                                        std::vector<std::vector<cv::Point2f>>&
+                                                        allFoundCorners,
+                                                        std::vector<std::vector<int>>& allFoundIds,
+                                                        cv::Size& imageSize,
+                                                        const std::function<void(size_t, size_t)>&
+                                                        progress,
+                                                        const std::string& cacheFileName) const
+{
+    std::map<std::uint64_t, CachedCorners> cache;
+    if (!cacheFileName.empty())
+    {
+        loadCornerCache(cacheFileName, cache);
+    }
+
+    std::vector<std::uint64_t> hashes(fileNames.size(), 0);
+    std::vector<CachedCorners> detected(fileNames.size());
+    std::vector<uchar> isDetected(fileNames.size(), 0);
+
+    getBoardCornersParallel(fileNames.size(),
+                            [&](const size_t i, std::vector<cv::Point2f>& corners,
+                                std::vector<int>& ids, cv::Size& size)
+                            {
+                                // only one file per worker is alive at a time
+                                std::ifstream inStream(fileNames[i], std::ios::binary);
+                                std::vector<uchar> bytes((std::istreambuf_iterator<char>(inStream)),
+                                                         std::istreambuf_iterator<char>());
+                                if (bytes.empty())
+                                {
+                                    return false;
+                                }
+                                hashes[i] = contentHash(bytes);
+
+                                const auto cached = cache.find(hashes[i]);
+                                if (cached != cache.end())
+                                {
+                                    corners = cached->second.corners;
+                                    ids = cached->second.ids;
+                                    size = cached->second.imageSize;
+                                    return cached->second.found;
+                                }
+
+                                const cv::Mat image = cv::imdecode(bytes, cv::IMREAD_GRAYSCALE);
+                                if (image.empty())
+                                {
+                                    return false;
+                                }
+                                size = image.size();
+                                const bool found = findBoardCorners(image, corners, ids);
+                                detected[i] = CachedCorners{found, size, corners, ids};
+                                isDetected[i] = 1;
+                                return found;
+                            },
+                            allFoundCorners, allFoundIds, imageSize, progress);
+
+    bool cacheChanged = false;
+    for (size_t i = 0; i < fileNames.size(); ++i)
+    {
+        if (isDetected[i])
+        {
+            cache[hashes[i]] = std::move(detected[i]);
+            cacheChanged = true;
+        }
+    }
+    if (cacheChanged && !cacheFileName.empty())
+    {
+        saveCornerCache(cacheFileName, cache);
+    }
+}
+
+bool timur::CameraCalibration::loadCornerCache(const std::string& fileName,
+                                               std::map<std::uint64_t, CachedCorners>& cache) const
+{
+    std::ifstream inStream(fileName, std::ios::binary);
+    if (!inStream)
+    {
+        return false;
+    }
+
+    // entries are valid only for the same board and detector settings
+    char signature[sizeof(cornerCacheSignature)];
+    std::uint32_t version;
+    std::int32_t pattern, boardWidth, boardHeight, flags, windowWidth, windowHeight, maxCount;
+    std::int32_t dictionaryId;
+    float squareLength, markerLength;
+    double epsilon;
+    std::uint64_t countOfEntries;
+    inStream.read(signature, sizeof(signature));
+    readValue(inStream, version);
+    readValue(inStream, pattern);
+    readValue(inStream, boardWidth);
+    readValue(inStream, boardHeight);
+    readValue(inStream, flags);
+    readValue(inStream, windowWidth);
+    readValue(inStream, windowHeight);
+    readValue(inStream, maxCount);
+    readValue(inStream, epsilon);
+    readValue(inStream, dictionaryId);
+    readValue(inStream, squareLength);
+    readValue(inStream, markerLength);
+    readValue(inStream, countOfEntries);
+    if (!inStream || std::memcmp(signature, cornerCacheSignature, sizeof(signature)) != 0
+        || version != cornerCacheVersion || pattern != static_cast<std::int32_t>(_pattern)
+        || boardWidth != _boardSize.width || boardHeight != _boardSize.height
+        || flags != chessboardFlags || windowWidth != subPixWindowSize.width
+        || windowHeight != subPixWindowSize.height || maxCount != subPixCriteria.maxCount
+        || epsilon != subPixCriteria.epsilon || dictionaryId != _charucoDictionaryId
+        || squareLength != (_charucoBoard.empty() ? 0.0f : _charucoBoard->getSquareLength())
+        || markerLength != (_charucoBoard.empty() ? 0.0f : _charucoBoard->getMarkerLength()))
+    {
+        return false;
+    }
+
+    // an image has at most every point of the board, a larger count means a damaged file
+    std::vector<cv::Point3f> knownBoardPosition;
+    createKnownBoardPosition(knownBoardPosition);
+    const std::uint32_t countOfBoardPoints = static_cast<std::uint32_t>(knownBoardPosition.size());
+
+    std::map<std::uint64_t, CachedCorners> entries;
+    for (std::uint64_t i = 0; i < countOfEntries; ++i)
+    {
+        std::uint64_t hash;
+        std::uint8_t found;
+        std::int32_t width, height;
+        std::uint32_t countOfCorners, countOfIds;
+        readValue(inStream, hash);
+        readValue(inStream, found);
+        readValue(inStream, width);
+        readValue(inStream, height);
+        readValue(inStream, countOfCorners);
+        readValue(inStream, countOfIds);
+        if (!inStream || countOfCorners > countOfBoardPoints
+            || (countOfIds != 0 && countOfIds != countOfCorners))
+        {
+            return false;
+        }
+        CachedCorners& entry = entries[hash];
+        entry.found = found != 0;
+        entry.imageSize = cv::Size(width, height);
+        entry.corners.resize(countOfCorners);
+        entry.ids.resize(countOfIds);
+        inStream.read(reinterpret_cast<char*>(entry.corners.data()),
+                      countOfCorners * sizeof(cv::Point2f));
+        inStream.read(reinterpret_cast<char*>(entry.ids.data()), countOfIds * sizeof(int));
+        const auto isOutOfBoard = [&](const int id)
+        {
+            return id < 0 || static_cast<std::uint32_t>(id) >= countOfBoardPoints;
+        };
+        if (!inStream || std::any_of(entry.ids.begin(), entry.ids.end(), isOutOfBoard))
+        {
+            return false;
+        }
+    }
+
+    cache.swap(entries);
+    return true;
+}
+
+bool timur::CameraCalibration::saveCornerCache(
+    const std::string& fileName, const std::map<std::uint64_t, CachedCorners>& cache) const
+{
+    std::ofstream outStream(fileName, std::ios::binary);
+    if (!outStream)
+    {
+        return false;
+    }
+
+    // header with board and detector settings, then hash, image size, corners and ids of every
+    // image
+    outStream.write(cornerCacheSignature, sizeof(cornerCacheSignature));
+    writeValue(outStream, cornerCacheVersion);
+    writeValue(outStream, static_cast<std::int32_t>(_pattern));
+    writeValue(outStream, static_cast<std::int32_t>(_boardSize.width));
+    writeValue(outStream, static_cast<std::int32_t>(_boardSize.height));
+    writeValue(outStream, static_cast<std::int32_t>(chessboardFlags));
+    writeValue(outStream, static_cast<std::int32_t>(subPixWindowSize.width));
+    writeValue(outStream, static_cast<std::int32_t>(subPixWindowSize.height));
+    writeValue(outStream, static_cast<std::int32_t>(subPixCriteria.maxCount));
+    writeValue(outStream, subPixCriteria.epsilon);
+    writeValue(outStream, static_cast<std::int32_t>(_charucoDictionaryId));
+    writeValue(outStream, _charucoBoard.empty() ? 0.0f : _charucoBoard->getSquareLength());
+    writeValue(outStream, _charucoBoard.empty() ? 0.0f : _charucoBoard->getMarkerLength());
+    writeValue(outStream, static_cast<std::uint64_t>(cache.size()));
+    for (const auto& hashAndEntry : cache)
+    {
+        const CachedCorners& entry = hashAndEntry.second;
+        writeValue(outStream, hashAndEntry.first);
+        writeValue(outStream, static_cast<std::uint8_t>(entry.found ? 1 : 0));
+        writeValue(outStream, static_cast<std::int32_t>(entry.imageSize.width));
+        writeValue(outStream, static_cast<std::int32_t>(entry.imageSize.height));
+        writeValue(outStream, static_cast<std::uint32_t>(entry.corners.size()));
+        writeValue(outStream, static_cast<std::uint32_t>(entry.ids.size()));
+        outStream.write(reinterpret_cast<const char*>(entry.corners.data()),
+                        entry.corners.size() * sizeof(cv::Point2f));
+        outStream.write(reinterpret_cast<const char*>(entry.ids.data()),
+                        entry.ids.size() * sizeof(int));
+    }
+    return static_cast<bool>(outStream);
+}
+
+double timur::CameraCalibration::calibrateFromCorners(
+    const std::vector<std::vector<cv::Point2f>>& imageSpacePoints,
+    const std::vector<std::vector<int>>& imageSpaceIds, const cv::Size imageSize, const int flags,
+    const cv::TermCriteria criteria)
+{
+    if (imageSpacePoints.empty() || imageSpaceIds.size() != imageSpacePoints.size())
+    {
+        return -1.0;
+    }
+
+    std::vector<cv::Point3f> knownBoardPosition;
+    createKnownBoardPosition(knownBoardPosition);
+
+    // partially visible charuco board has only the points with found identifiers, views with
+    // identifiers out of the board are skipped
+    std::vector<std::vector<cv::Point3f>> worldSpaceCornerPoints;
+    std::vector<std::vector<cv::Point2f>> usedImageSpacePoints;
+    for (size_t i = 0; i < imageSpacePoints.size(); ++i)
+    {
+        const std::vector<int>& ids = imageSpaceIds[i];
+        std::vector<cv::Point3f> worldPoints;
+        if (ids.empty())
+        {
+            worldPoints = knownBoardPosition;
+        }
+        else
+        {
+            for (const int id : ids)
+            {
+                if (id < 0 || static_cast<size_t>(id) >= knownBoardPosition.size())
                 {
-                    allFoundCorners.push_back(pointBuf);
+                    worldPoints.clear();
+                    break;
                 }
+                worldPoints.push_back(knownBoardPosition[id]);
             }
-            break;
+        }
+        if (worldPoints.empty() || worldPoints.size() != imageSpacePoints[i].size())
+        {
+            continue;
+        }
+        worldSpaceCornerPoints.push_back(std::move(worldPoints));
+        usedImageSpacePoints.push_back(imageSpacePoints[i]);
+    }
+    if (worldSpaceCornerPoints.empty())
+    {
+        return -1.0;
+    }
+
+    _imageSize = imageSize;
+    std::vector<cv::Mat> tVec;
+    std::vector<cv::Mat> rVec;
+    return cv::calibrateCamera(worldSpaceCornerPoints, usedImageSpacePoints, imageSize,
+                               _cameraMatrix, _distortionCoefficients, rVec, tVec, flags,
+                               criteria);
+}
+
+double timur::CameraCalibration::addCalibrationImage(const cv::Mat& image, const size_t windowSize)
+{
+    std::vector<cv::Point2f> corners;
+    std::vector<int> ids;
+    if (!findBoardCorners(image, corners, ids))
+    {
+        return -1.0;
+    }
+    if (_windowImageSize != image.size())
+    {
+        resetCalibrationWindow();
+        _windowImageSize = image.size();
+    }
+
+    _windowCorners.push_back(std::move(corners));
+    _windowIds.push_back(std::move(ids));
+    while (_windowCorners.size() > std::max(windowSize, minCalibrationWindow))
+    {
+        _windowCorners.pop_front();
+        _windowIds.pop_front();
     }
+    if (_windowCorners.size() < minCalibrationWindow)
+    {
+        return 0.0;
+    }
+
+    // the first solve runs to convergence, the next ones start from the current intrinsics and
+    // stop after a few iterations. The views are still initialized by cv::calibrateCamera, its
+    // extrinsics are outputs only
+    const std::vector<std::vector<cv::Point2f>> windowCorners(_windowCorners.begin(),
+                                                              _windowCorners.end());
+    const std::vector<std::vector<int>> windowIds(_windowIds.begin(), _windowIds.end());
+    if (_cameraMatrix.empty())
+    {
+        return calibrateFromCorners(windowCorners, windowIds, _windowImageSize);
+    }
+    return calibrateFromCorners(windowCorners, windowIds, _windowImageSize,
+                                cv::CALIB_USE_INTRINSIC_GUESS, incrementalCriteria);
+}
+
+void timur::CameraCalibration::resetCalibrationWindow()
+{
+    _windowCorners.clear();
+    _windowIds.clear();
+    _windowImageSize = cv::Size();
 }
 
 void timur::CameraCalibration::calculateIntrinsicParameters(
-    const std::vector<cv::Mat>& calibrationImages)
+    const std::vector<cv::Mat>& calibrationImages,
+    const std::function<void(size_t, size_t)>& progress)
 {
     std::vector<std::vector<cv::Point2f>> chessboardImageSpacePoints;
-    getBoardCorners(calibrationImages, chessboardImageSpacePoints);
-
-    std::vector<std::vector<cv::Point3f>> worldSpaceCornerPoints(1);
-    createKnownBoardPosition(worldSpaceCornerPoints[0]);
-    worldSpaceCornerPoints.resize(chessboardImageSpacePoints.size(), worldSpaceCornerPoints[0]);
+    std::vector<std::vector<int>> chessboardImageSpaceIds;
+    cv::Size imageSize;
+    getBoardCorners(calibrationImages, chessboardImageSpacePoints, chessboardImageSpaceIds,
+                    imageSize, progress);
+    calibrateFromCorners(chessboardImageSpacePoints, chessboardImageSpaceIds, imageSize);
+}
 
-    std::vector<cv::Mat> tVec;
-    std::vector<cv::Mat> rVec;
-    cv::calibrateCamera(worldSpaceCornerPoints, chessboardImageSpacePoints, _boardSize,
-                        _cameraMatrix,
-                        _distortionCoefficients, rVec, tVec);
+void timur::CameraCalibration::calculateIntrinsicParameters(
+    const std::vector<std::string>& calibrationImageFiles,
+    const std::function<void(size_t, size_t)>& progress, const std::string& cacheFileName)
+{
+    std::vector<std::vector<cv::Point2f>> chessboardImageSpacePoints;
+    std::vector<std::vector<int>> chessboardImageSpaceIds;
+    cv::Size imageSize;
+    getBoardCornersFromFiles(calibrationImageFiles, chessboardImageSpacePoints,
+                             chessboardImageSpaceIds, imageSize, progress, cacheFileName);
+    calibrateFromCorners(chessboardImageSpacePoints, chessboardImageSpaceIds, imageSize);
 }
 
-timur::CameraCalibration::CameraCalibration(const cv::Size boardDimension, const uint patternCode)
+timur::CameraCalibration::CameraCalibration(const cv::Size boardDimension, const uint patternCode,
+                                            const float squareLength, const float markerLength,
+                                            const int charucoDictionaryId)
     : _pattern(static_cast<Pattern>(patternCode)),
-      _boardSize(boardDimension)
+      _boardSize(boardDimension),
+      _charucoDictionaryId(charucoDictionaryId)
 {
+    if (_pattern == Pattern::CHARUCO)
+    {
+        _charucoBoard = cv::aruco::CharucoBoard::create(
+            _boardSize.width, _boardSize.height, squareLength, markerLength,
+            cv::aruco::getPredefinedDictionary(charucoDictionaryId));
+        _charucoDetectorParameters = cv::aruco::DetectorParameters::create();
+    }
 }
@@ -5,6 +5,13 @@
 #ifndef CAMERA_CALIBRATION_2017
 #define CAMERA_CALIBRATION_2017
 #include <opencv2/core.hpp>
+#include <charuco.hpp>
+#include <cfloat>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
 #include <vector>
 
 namespace timur
@@ -17,20 +24,49 @@ class CameraCalibration
 protected:
 
     /**
-     * \brief Pattern for calibration.(chessboard = 0, circlesGrid = 1, asymmetricCirclesGrid = 2).
+     * \brief Pattern for calibration.(chessboard = 0, circlesGrid = 1, asymmetricCirclesGrid = 2,
+     * charuco = 3).
      */
     enum class Pattern
     {
         CHESSBOARD,
         CIRCLES_GRID,
-        ASYMMETRIC_CIRCLES_GRID
+        ASYMMETRIC_CIRCLES_GRID,
+        CHARUCO
     } const _pattern;
 
     /**
      * \brief Dimension of chessboard or circle grid pattern (Number of items by width and height).
+     * For charuco board it is the number of squares by width and height.
      */
     const cv::Size _boardSize;
 
+    /**
+     * \brief Identifier of the predefined dictionary of charuco board markers.
+     */
+    const int _charucoDictionaryId;
+
+    /**
+     * \brief Charuco board, created only for charuco pattern.
+     */
+    cv::Ptr<cv::aruco::CharucoBoard> _charucoBoard;
+
+    /**
+     * \brief Parameters of charuco board markers detection.
+     */
+    cv::Ptr<cv::aruco::DetectorParameters> _charucoDetectorParameters;
+
+    /**
+     * \brief Detection result of one image stored in the corner cache.
+     */
+    struct CachedCorners
+    {
+        bool found;
+        cv::Size imageSize;
+        std::vector<cv::Point2f> corners;
+        std::vector<int> ids;
+    };
+
     /**
     * \brief Camera matrix - intrinsic parameters of the camera.
     * 
@@ -53,28 +89,162 @@ protected:
     */
     cv::Mat _distortionCoefficients;
 
+    /**
+     * \brief Size of the images the camera was calibrated on (empty if unknown).
+     */
+    cv::Size _imageSize;
+
+    /**
+     * \brief Board points of the latest frames of incremental calibration.
+     */
+    std::deque<std::vector<cv::Point2f>> _windowCorners;
+
+    /**
+     * \brief Identifiers of the board points of the latest frames, see findBoardCorners.
+     */
+    std::deque<std::vector<int>> _windowIds;
+
+    /**
+     * \brief Size of the frames of incremental calibration.
+     */
+    cv::Size _windowImageSize;
+
     /**
      * \brief Creation of real 3-dimensional coordinates for chessboard/circle grid points. 
+     * For charuco board these are all chessboard corners in the order of their identifiers.
      * \param[out] corners Output vector of 3-dimenshion points.
      */
     void createKnownBoardPosition(std::vector<cv::Point3f>& corners) const;
 
+    /**
+     * \brief Find chessboard/circle grid points on one image.
+     * Charuco board is found also if it is partially visible.
+     * \param[in] image Greyscale image, where need to find a chessboard/circle grid.
+     * \param[out] corners Output vector of 2-dimenshion coordinates of chessboard/circle grid points.
+     * \param[out] ids Identifiers of the found charuco corners, empty for other patterns
+     * (all points are found).
+     * \return True, if the pattern was found, and false, if not.
+     */
+    bool findBoardCorners(const cv::Mat& image, std::vector<cv::Point2f>& corners,
+                          std::vector<int>& ids) const;
+
+    /**
+     * \brief Find chessboard/circle grid points on images given by index.
+     * Images are loaded and processed in parallel, found corners keep the order of the images.
+     * \param[in] countOfImages Count of images.
+     * \param[in] detectOnImage Function finding the pattern (corners and identifiers) and the image
+     * size on the image with certain index, returning true if the pattern was found.
+     * \param[out] allFoundCorners Output vector of 2-dimenshion coordinates of chessboard/circle grid points.
+     * \param[out] allFoundIds Identifiers of the found points of every image, see findBoardCorners.
+     * \param[out] imageSize Size of the first image with found pattern, if it was empty.
+     * \param[in] progress Optional function called with count of processed images and count of
+     * all images after every image (calls are serialized).
+     */
+    void getBoardCornersParallel(const size_t countOfImages,
+                                 const std::function<bool(size_t, std::vector<cv::Point2f>&,
+                                                          std::vector<int>&, cv::Size&)>&
+                                 detectOnImage,
+                                 std::vector<std::vector<cv::Point2f>>& allFoundCorners,
+                                 std::vector<std::vector<int>>& allFoundIds,
+                                 cv::Size& imageSize,
+                                 const std::function<void(size_t, size_t)>& progress) const;
+
     /**
      * \brief Find chessboard/circle grid points on collection of images.
      * \param[in] images Input vector of matrices, where need to find a chessboard/circle grid.
      * \param[out] allFoundCorners Output vector of 2-dimenshion coordinates of chessboard/circle grid points.
+     * \param[out] allFoundIds Identifiers of the found points of every image, see findBoardCorners.
+     * \param[out] imageSize Size of the images.
+     * \param[in] progress Optional function reporting progress, see getBoardCornersParallel.
      */
     void getBoardCorners(const std::vector<cv::Mat>& images,
-                         std::vector<std::vector<cv::Point2f>>& allFoundCorners) const;
+                         std::vector<std::vector<cv::Point2f>>& allFoundCorners,
+                         std::vector<std::vector<int>>& allFoundIds, cv::Size& imageSize,
+                         const std::function<void(size_t, size_t)>& progress = nullptr) const;
+
+    /**
+     * \brief Find chessboard/circle grid points on image files. Files are decoded by the same
+     * workers that detect the pattern, so only the corners of all images are kept in memory.
+     * Files found in the corner cache by their content hash are not decoded at all.
+     * \param[in] fileNames Names of the image files.
+     * \param[out] allFoundCorners Output vector of 2-dimenshion coordinates of chessboard/circle grid points.
+     * \param[out] allFoundIds Identifiers of the found points of every image, see findBoardCorners.
+     * \param[out] imageSize Size of the images.
+     * \param[in] progress Optional function reporting progress, see getBoardCornersParallel.
+     * \param[in] cacheFileName Name of the corner cache file, empty to detect without cache.
+     */
+    void getBoardCornersFromFiles(const std::vector<std::string>& fileNames,
+                                  std::vector<std::vector<cv::Point2f>>& allFoundCorners,
+                                  std::vector<std::vector<int>>& allFoundIds,
+                                  cv::Size& imageSize,
+                                  const std::function<void(size_t, size_t)>& progress = nullptr,
+                                  const std::string& cacheFileName = "") const;
+
+    /**
+     * \brief Loading the corner cache. The cache is rejected, if it was written for another
+     * pattern, board size or detector settings.
+     * \param[in] fileName Name of the cache file.
+     * \param[out] cache Detection results by content hash of the image file.
+     * \return True, if the cache was loaded, and false, if not.
+     */
+    bool loadCornerCache(const std::string& fileName,
+                         std::map<std::uint64_t, CachedCorners>& cache) const;
+
+    /**
+     * \brief Saving the corner cache together with the pattern, board size and detector settings.
+     * \param[in] fileName Name of the cache file.
+     * \param[in] cache Detection results by content hash of the image file.
+     * \return True, if the cache was saved, and false, if not.
+     */
+    bool saveCornerCache(const std::string& fileName,
+                         const std::map<std::uint64_t, CachedCorners>& cache) const;
+
+    /**
+     * \brief Calibrating the camera on found chessboard/circle grid points.
+     * \param[in] imageSpacePoints Points of the pattern on every image.
+     * \param[in] imageSpaceIds Identifiers of the points on every image, see findBoardCorners.
+     * \param[in] imageSize Size of the images.
+     * \param[in] flags Flags of cv::calibrateCamera.
+     * \param[in] criteria Termination criteria of cv::calibrateCamera.
+     * \return RMS reprojection error in pixels, negative if there are no valid views.
+     */
+    double calibrateFromCorners(const std::vector<std::vector<cv::Point2f>>& imageSpacePoints,
+                                const std::vector<std::vector<int>>& imageSpaceIds,
+                                const cv::Size imageSize, const int flags = 0,
+                                const cv::TermCriteria criteria = cv::TermCriteria(
+                                    cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 30,
+                                    DBL_EPSILON));
+
+    /**
+     * \brief Incremental calibration: adding the image to the window of the latest frames and
+     * refining the current intrinsics on the window (cv::CALIB_USE_INTRINSIC_GUESS) with a few
+     * iterations.
+     * \param[in] image Greyscale image with chessboard/circle grid.
+     * \param[in] windowSize Maximum count of the latest frames used for refinement, the first
+     * solve waits for 3 frames.
+     * \return RMS reprojection error in pixels after the update, zero if the frame was added
+     * without a solve, negative if the pattern was not found on the image.
+     */
+    double addCalibrationImage(const cv::Mat& image, const size_t windowSize = 20);
+
+    /**
+     * \brief Forgetting the frames of incremental calibration, the intrinsics are kept.
+     */
+    void resetCalibrationWindow();
 
     /**
      * \brief CameraCalibration constructor.
      * \param[in] boardDimension Dimension of chessboard or circle grid pattern 
-     * (Number of items by width and height).
+     * (Number of items by width and height, number of squares for charuco board).
      * \param[in] patternCode Code of using pattern
-     * (chessboard = 0, circlesGrid = 1, asymmetricCirclesGrid = 2).
+     * (chessboard = 0, circlesGrid = 1, asymmetricCirclesGrid = 2, charuco = 3).
+     * \param[in] squareLength Length of the charuco board square.
+     * \param[in] markerLength Length of the charuco board marker side (less than squareLength).
+     * \param[in] charucoDictionaryId Identifier of the predefined dictionary of charuco markers.
      */
-    explicit CameraCalibration(const cv::Size boardDimension, const uint patternCode);
+    explicit CameraCalibration(const cv::Size boardDimension, const uint patternCode,
+                               const float squareLength = 1.0f, const float markerLength = 0.5f,
+                               const int charucoDictionaryId = cv::aruco::DICT_4X4_50);
 
     /**
      * \brief CameraCalibration destructor.
@@ -84,8 +254,21 @@ protected:
     /**
     * \brief Calibrating the camera on the image collection.
     * \param[in] calibrationImages Input vector of images with chessboard/circle grid.
+    * \param[in] progress Optional function reporting progress of the corners detection.
+    */
+    void calculateIntrinsicParameters(const std::vector<cv::Mat>& calibrationImages,
+                                      const std::function<void(size_t, size_t)>& progress =
+                                      nullptr);
+
+    /**
+    * \brief Calibrating the camera on image files without keeping the images in memory.
+    * \param[in] calibrationImageFiles Names of the image files with chessboard/circle grid.
+    * \param[in] progress Optional function reporting progress of the corners detection.
+    * \param[in] cacheFileName Name of the corner cache file, empty to detect without cache.
     */
-    void calculateIntrinsicParameters(const std::vector<cv::Mat>& calibrationImages);
+    void calculateIntrinsicParameters(const std::vector<std::string>& calibrationImageFiles,
+                                      const std::function<void(size_t, size_t)>& progress =
+                                      nullptr, const std::string& cacheFileName = "");
 };
 }
 
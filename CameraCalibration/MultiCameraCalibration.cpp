@@ -0,0 +1,661 @@
+#include "MultiCameraCalibration.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <opencv2/calib3d/calib3d.hpp>
+#include <opencv2/core/utility.hpp>
+#include <opencv2/imgproc.hpp>
+
+namespace
+{
+/**
+ * \brief First bytes of a multi-camera calibration file.
+ */
+const char multiCameraSignature[4] = {'M', 'C', 'A', 'L'};
+
+/**
+ * \brief Version of the multi-camera calibration file format.
+ */
+const std::uint32_t multiCameraVersion = 1;
+
+/**
+ * \brief Maximum count of distortion coefficients in OpenCV models.
+ */
+const std::uint32_t maxDistortionCoefficients = 14;
+
+/**
+ * \brief Minimum relative decrease of the squared error to continue the refinement.
+ */
+const double minRelativeDecrease = 1e-10;
+
+/**
+ * \brief Header of the multi-camera calibration file, it is followed by a record of every camera.
+ */
+struct MultiCameraFileHeader
+{
+    char signature[4];
+    std::uint32_t version;
+    std::uint32_t countOfCameras;
+    std::uint32_t referenceCamera;
+};
+
+/**
+ * \brief Intrinsics and pose of one camera in the multi-camera calibration file. The pose is the
+ * transformation from the reference camera frame to the camera frame.
+ */
+struct CameraRecord
+{
+    std::int32_t width;
+    std::int32_t height;
+    double cameraMatrix[9];
+    double distortionCoefficients[maxDistortionCoefficients];
+    std::uint32_t countOfDistortionCoefficients;
+    std::uint32_t reserved;
+    double rotation[3];
+    double translation[3];
+};
+
+static_assert(sizeof(CameraRecord) == 248, "camera record must not be padded");
+
+/**
+ * \brief Rigid transformation given by rotation and translation vectors.
+ */
+struct Pose
+{
+    cv::Vec3d rotation;
+    cv::Vec3d translation;
+};
+
+/**
+ * \brief Board points found by one camera on one observation with the board pose estimated by
+ * this camera alone.
+ */
+struct Observation
+{
+    size_t view;
+    size_t camera;
+    std::vector<cv::Point3f> objectPoints;
+    std::vector<cv::Point2f> imagePoints;
+    Pose boardToCamera;
+};
+
+/**
+ * \brief Normal equations of the bundle adjustment. Unknowns are the poses of the cameras
+ * except the reference one (camera blocks) and the poses of the board on every observation
+ * (board blocks). Board blocks do not depend on each other, so their part is block diagonal.
+ */
+struct NormalEquations
+{
+    cv::Mat cameraBlock;
+    cv::Mat cameraGradient;
+    std::vector<cv::Mat> boardBlocks;
+    std::vector<cv::Mat> boardGradients;
+    std::vector<cv::Mat> crossBlocks;
+};
+
+/**
+ * \brief Transformation 4x4 of the pose.
+ */
+cv::Matx44d toTransform(const Pose& pose)
+{
+    cv::Matx33d rotation;
+    cv::Rodrigues(pose.rotation, rotation);
+    return cv::Matx44d(rotation(0, 0), rotation(0, 1), rotation(0, 2), pose.translation[0],
+                       rotation(1, 0), rotation(1, 1), rotation(1, 2), pose.translation[1],
+                       rotation(2, 0), rotation(2, 1), rotation(2, 2), pose.translation[2],
+                       0.0, 0.0, 0.0, 1.0);
+}
+
+/**
+ * \brief Pose of the rigid transformation 4x4.
+ */
+Pose toPose(const cv::Matx44d& transform)
+{
+    Pose pose;
+    const cv::Matx33d rotation = transform.get_minor<3, 3>(0, 0);
+    cv::Rodrigues(rotation, pose.rotation);
+    pose.translation = cv::Vec3d(transform(0, 3), transform(1, 3), transform(2, 3));
+    return pose;
+}
+
+/**
+ * \brief Inverse of the rigid transformation 4x4.
+ */
+cv::Matx44d inverseTransform(const cv::Matx44d& transform)
+{
+    const cv::Matx33d rotation = transform.get_minor<3, 3>(0, 0).t();
+    const cv::Vec3d translation = -(rotation * cv::Vec3d(transform(0, 3), transform(1, 3),
+                                                         transform(2, 3)));
+    return cv::Matx44d(rotation(0, 0), rotation(0, 1), rotation(0, 2), translation[0],
+                       rotation(1, 0), rotation(1, 1), rotation(1, 2), translation[1],
+                       rotation(2, 0), rotation(2, 1), rotation(2, 2), translation[2],
+                       0.0, 0.0, 0.0, 1.0);
+}
+
+/**
+ * \brief Derivative 6x6 of the composed pose (rotation, translation) by one of the poses.
+ */
+cv::Mat poseDerivative(const cv::Mat& rotationByRotation, const cv::Mat& rotationByTranslation,
+                       const cv::Mat& translationByRotation,
+                       const cv::Mat& translationByTranslation)
+{
+    cv::Mat derivative(6, 6, CV_64F);
+    rotationByRotation.copyTo(derivative(cv::Rect(0, 0, 3, 3)));
+    rotationByTranslation.copyTo(derivative(cv::Rect(3, 0, 3, 3)));
+    translationByRotation.copyTo(derivative(cv::Rect(0, 3, 3, 3)));
+    translationByTranslation.copyTo(derivative(cv::Rect(3, 3, 3, 3)));
+    return derivative;
+}
+
+/**
+ * \brief Sum of squared reprojection errors of all observations for the camera poses (from the
+ * reference camera frame) and the board poses (to the reference camera frame). The normal
+ * equations are accumulated, if they are given.
+ */
+double reprojectionErrors(const std::vector<Observation>& observations,
+                          const std::vector<cv::Mat>& cameraMatrices,
+                          const std::vector<cv::Mat>& distortionCoefficients,
+                          const std::vector<int>& cameraBlocks,
+                          const std::vector<Pose>& cameraPoses,
+                          const std::vector<Pose>& boardPoses, NormalEquations* equations)
+{
+    double sumOfSquares = 0.0;
+    for (const auto& observation : observations)
+    {
+        const Pose& camera = cameraPoses[observation.camera];
+        const Pose& board = boardPoses[observation.view];
+        cv::Mat rotation, translation;
+        cv::Mat dr3dr1, dr3dt1, dr3dr2, dr3dt2, dt3dr1, dt3dt1, dt3dr2, dt3dt2;
+        cv::composeRT(board.rotation, board.translation, camera.rotation, camera.translation,
+                      rotation, translation, dr3dr1, dr3dt1, dr3dr2, dr3dt2, dt3dr1, dt3dt1,
+                      dt3dr2, dt3dt2);
+
+        std::vector<cv::Point2f> projected;
+        cv::Mat jacobian;
+        if (equations == nullptr)
+        {
+            cv::projectPoints(observation.objectPoints, rotation, translation,
+                              cameraMatrices[observation.camera],
+                              distortionCoefficients[observation.camera], projected);
+        }
+        else
+        {
+            cv::projectPoints(observation.objectPoints, rotation, translation,
+                              cameraMatrices[observation.camera],
+                              distortionCoefficients[observation.camera], projected, jacobian);
+        }
+
+        cv::Mat residuals(static_cast<int>(2 * projected.size()), 1, CV_64F);
+        for (size_t i = 0; i < projected.size(); ++i)
+        {
+            const cv::Point2f difference = projected[i] - observation.imagePoints[i];
+            residuals.at<double>(static_cast<int>(2 * i)) = difference.x;
+            residuals.at<double>(static_cast<int>(2 * i + 1)) = difference.y;
+            sumOfSquares += difference.dot(difference);
+        }
+        if (equations == nullptr)
+        {
+            continue;
+        }
+
+        // first six columns are derivatives by the rotation and translation of the composed pose
+        const cv::Mat projectionByPose = jacobian.colRange(0, 6);
+        const cv::Mat byBoard = projectionByPose * poseDerivative(dr3dr1, dr3dt1, dt3dr1, dt3dt1);
+        equations->boardBlocks[observation.view] += byBoard.t() * byBoard;
+        equations->boardGradients[observation.view] += byBoard.t() * residuals;
+
+        const int block = cameraBlocks[observation.camera];
+        if (block < 0)
+        {
+            continue;
+        }
+        const cv::Mat byCamera = projectionByPose * poseDerivative(dr3dr2, dr3dt2, dt3dr2, dt3dt2);
+        cv::Mat cameraBlock = equations->cameraBlock(cv::Rect(6 * block, 6 * block, 6, 6));
+        cameraBlock += byCamera.t() * byCamera;
+        cv::Mat cameraGradient = equations->cameraGradient.rowRange(6 * block, 6 * block + 6);
+        cameraGradient += byCamera.t() * residuals;
+        cv::Mat crossBlock = equations->crossBlocks[observation.view].rowRange(6 * block,
+                                                                               6 * block + 6);
+        crossBlock += byCamera.t() * byBoard;
+    }
+    return sumOfSquares;
+}
+
+/**
+ * \brief Zeroed normal equations for the count of camera blocks and of board poses.
+ */
+NormalEquations createNormalEquations(const int countOfCameraBlocks, const size_t countOfBoards)
+{
+    NormalEquations equations;
+    equations.cameraBlock = cv::Mat::zeros(6 * countOfCameraBlocks, 6 * countOfCameraBlocks,
+                                           CV_64F);
+    equations.cameraGradient = cv::Mat::zeros(6 * countOfCameraBlocks, 1, CV_64F);
+    for (size_t i = 0; i < countOfBoards; ++i)
+    {
+        equations.boardBlocks.push_back(cv::Mat::zeros(6, 6, CV_64F));
+        equations.boardGradients.push_back(cv::Mat::zeros(6, 1, CV_64F));
+        equations.crossBlocks.push_back(cv::Mat::zeros(6 * countOfCameraBlocks, 6, CV_64F));
+    }
+    return equations;
+}
+
+/**
+ * \brief Multiplying the diagonal of the matrix by (1 + lambda).
+ */
+void dampDiagonal(cv::Mat& matrix, const double lambda)
+{
+    for (int i = 0; i < matrix.rows; ++i)
+    {
+        matrix.at<double>(i, i) *= 1.0 + lambda;
+    }
+}
+}
+
+timur::MultiCameraCalibration::MultiCameraCalibration(
+    const cv::Size boardDimension, const uint patternCode,
+    const std::vector<cv::Mat>& cameraMatrices, const std::vector<cv::Mat>& distortionCoefficients,
+    const float squareLength, const float markerLength, const int charucoDictionaryId)
+    : CameraCalibration(boardDimension, patternCode, squareLength, markerLength,
+                        charucoDictionaryId),
+      _imageSizes(cameraMatrices.size()),
+      _referenceCamera(0),
+      _cameraRotations(cameraMatrices.size()),
+      _cameraTranslations(cameraMatrices.size())
+{
+    CV_Assert(cameraMatrices.size() == distortionCoefficients.size());
+    for (size_t i = 0; i < cameraMatrices.size(); ++i)
+    {
+        _cameraMatrices.push_back(cameraMatrices[i].clone());
+        _cameraDistortionCoefficients.push_back(distortionCoefficients[i].clone());
+    }
+}
+
+timur::MultiCameraCalibration::MultiCameraCalibration(const std::string& calibrationFileName)
+    : CameraCalibration(cv::Size(), 0),
+      _referenceCamera(0)
+{
+    loadCalibration(calibrationFileName);
+}
+
+bool timur::MultiCameraCalibration::grabSimultaneously(std::vector<cv::VideoCapture>& cameras,
+                                                       std::vector<cv::Mat>& frames)
+{
+    frames.assign(cameras.size(), cv::Mat());
+    bool grabbed = true;
+    for (auto& camera : cameras)
+    {
+        grabbed = camera.grab() && grabbed;
+    }
+    for (size_t i = 0; i < cameras.size(); ++i)
+    {
+        grabbed = cameras[i].retrieve(frames[i]) && !frames[i].empty() && grabbed;
+    }
+    return grabbed;
+}
+
+int timur::MultiCameraCalibration::addObservation(const std::vector<cv::Mat>& images)
+{
+    CV_Assert(images.size() == _cameraMatrices.size());
+    std::vector<CameraView> views(images.size());
+    cv::parallel_for_(cv::Range(0, static_cast<int>(images.size())), [&](const cv::Range& range)
+    {
+        for (int i = range.start; i < range.end; ++i)
+        {
+            views[i].found = false;
+            if (images[i].empty())
+            {
+                continue;
+            }
+            cv::Mat gray = images[i];
+            if (gray.channels() != 1)
+            {
+                cv::cvtColor(images[i], gray, cv::COLOR_BGR2GRAY);
+            }
+            views[i].found = findBoardCorners(gray, views[i].corners, views[i].ids);
+        }
+    });
+
+    int countOfFound = 0;
+    for (size_t i = 0; i < views.size(); ++i)
+    {
+        if (views[i].found)
+        {
+            ++countOfFound;
+            _imageSizes[i] = images[i].size();
+        }
+    }
+    if (countOfFound >= 2)
+    {
+        _observations.push_back(std::move(views));
+    }
+    return countOfFound;
+}
+
+size_t timur::MultiCameraCalibration::countOfObservations() const
+{
+    return _observations.size();
+}
+
+void timur::MultiCameraCalibration::resetObservations()
+{
+    _observations.clear();
+}
+
+double timur::MultiCameraCalibration::calibrate(const size_t referenceCamera,
+                                                const int maxIterations)
+{
+    const size_t countOfCameras = _cameraMatrices.size();
+    if (referenceCamera >= countOfCameras || _observations.empty())
+    {
+        return -1.0;
+    }
+
+    std::vector<cv::Point3f> knownBoardPosition;
+    createKnownBoardPosition(knownBoardPosition);
+
+    // every camera estimates the board pose alone for the initial guess
+    std::vector<Observation> observations;
+    std::vector<std::vector<size_t>> observationsOfView(_observations.size());
+    size_t countOfPoints = 0;
+    for (size_t view = 0; view < _observations.size(); ++view)
+    {
+        for (size_t camera = 0; camera < countOfCameras; ++camera)
+        {
+            const CameraView& cameraView = _observations[view][camera];
+            if (!cameraView.found)
+            {
+                continue;
+            }
+            Observation observation{view, camera, {}, cameraView.corners, {}};
+            if (cameraView.ids.empty())
+            {
+                observation.objectPoints = knownBoardPosition;
+            }
+            for (const int id : cameraView.ids)
+            {
+                observation.objectPoints.push_back(knownBoardPosition[id]);
+            }
+            if (!cv::solvePnP(observation.objectPoints, observation.imagePoints,
+                              _cameraMatrices[camera], _cameraDistortionCoefficients[camera],
+                              observation.boardToCamera.rotation,
+                              observation.boardToCamera.translation))
+            {
+                continue;
+            }
+            observationsOfView[view].push_back(observations.size());
+            countOfPoints += observation.imagePoints.size();
+            observations.push_back(std::move(observation));
+        }
+    }
+
+    // camera poses are chained from the reference camera through the shared observations
+    std::vector<bool> known(countOfCameras, false);
+    std::vector<cv::Matx44d> referenceToCamera(countOfCameras, cv::Matx44d::eye());
+    known[referenceCamera] = true;
+    bool grown = true;
+    while (grown)
+    {
+        grown = false;
+        for (const auto& indices : observationsOfView)
+        {
+            for (const size_t from : indices)
+            {
+                if (!known[observations[from].camera])
+                {
+                    continue;
+                }
+                for (const size_t to : indices)
+                {
+                    const size_t camera = observations[to].camera;
+                    if (known[camera])
+                    {
+                        continue;
+                    }
+                    referenceToCamera[camera] = toTransform(observations[to].boardToCamera)
+                        * inverseTransform(toTransform(observations[from].boardToCamera))
+                        * referenceToCamera[observations[from].camera];
+                    known[camera] = true;
+                    grown = true;
+                }
+            }
+        }
+    }
+    if (std::find(known.begin(), known.end(), false) != known.end())
+    {
+        return -1.0;
+    }
+
+    std::vector<Pose> cameraPoses(countOfCameras);
+    std::vector<int> cameraBlocks(countOfCameras, -1);
+    int countOfCameraBlocks = 0;
+    for (size_t camera = 0; camera < countOfCameras; ++camera)
+    {
+        cameraPoses[camera] = toPose(referenceToCamera[camera]);
+        if (camera != referenceCamera)
+        {
+            cameraBlocks[camera] = countOfCameraBlocks++;
+        }
+    }
+    std::vector<Pose> boardPoses(_observations.size());
+    for (size_t view = 0; view < _observations.size(); ++view)
+    {
+        if (!observationsOfView[view].empty())
+        {
+            const Observation& first = observations[observationsOfView[view].front()];
+            boardPoses[view] = toPose(inverseTransform(referenceToCamera[first.camera])
+                                      * toTransform(first.boardToCamera));
+        }
+    }
+
+    // Levenberg-Marquardt, the board blocks are eliminated by the Schur complement
+    NormalEquations equations = createNormalEquations(countOfCameraBlocks, boardPoses.size());
+    double sumOfSquares = reprojectionErrors(observations, _cameraMatrices,
+                                             _cameraDistortionCoefficients, cameraBlocks,
+                                             cameraPoses, boardPoses, &equations);
+    double lambda = 1e-3;
+    for (int iteration = 0; iteration < maxIterations; ++iteration)
+    {
+        cv::Mat reducedBlock = equations.cameraBlock.clone();
+        cv::Mat reducedGradient = -equations.cameraGradient;
+        dampDiagonal(reducedBlock, lambda);
+        std::vector<cv::Mat> inverseBoardBlocks(boardPoses.size());
+        for (size_t view = 0; view < boardPoses.size(); ++view)
+        {
+            cv::Mat boardBlock = equations.boardBlocks[view].clone();
+            dampDiagonal(boardBlock, lambda);
+            // observations without points leave the block zero, the board keeps its pose
+            boardBlock += cv::Mat::eye(6, 6, CV_64F) * 1e-12;
+            cv::invert(boardBlock, inverseBoardBlocks[view], cv::DECOMP_CHOLESKY);
+            if (countOfCameraBlocks > 0)
+            {
+                const cv::Mat cross = equations.crossBlocks[view] * inverseBoardBlocks[view];
+                reducedBlock -= cross * equations.crossBlocks[view].t();
+                reducedGradient += cross * equations.boardGradients[view];
+            }
+        }
+        cv::Mat cameraStep = cv::Mat::zeros(6 * countOfCameraBlocks, 1, CV_64F);
+        if (countOfCameraBlocks > 0)
+        {
+            cv::solve(reducedBlock, reducedGradient, cameraStep, cv::DECOMP_CHOLESKY);
+        }
+
+        std::vector<Pose> candidateCameras = cameraPoses;
+        for (size_t camera = 0; camera < countOfCameras; ++camera)
+        {
+            const int block = cameraBlocks[camera];
+            if (block < 0)
+            {
+                continue;
+            }
+            for (int i = 0; i < 3; ++i)
+            {
+                candidateCameras[camera].rotation[i] += cameraStep.at<double>(6 * block + i);
+                candidateCameras[camera].translation[i] += cameraStep.at<double>(6 * block + 3 + i);
+            }
+        }
+        std::vector<Pose> candidateBoards = boardPoses;
+        for (size_t view = 0; view < boardPoses.size(); ++view)
+        {
+            cv::Mat boardGradient = -equations.boardGradients[view];
+            if (countOfCameraBlocks > 0)
+            {
+                boardGradient -= equations.crossBlocks[view].t() * cameraStep;
+            }
+            const cv::Mat boardStep = inverseBoardBlocks[view] * boardGradient;
+            for (int i = 0; i < 3; ++i)
+            {
+                candidateBoards[view].rotation[i] += boardStep.at<double>(i);
+                candidateBoards[view].translation[i] += boardStep.at<double>(3 + i);
+            }
+        }
+
+        const double candidateSumOfSquares = reprojectionErrors(
+            observations, _cameraMatrices, _cameraDistortionCoefficients, cameraBlocks,
+            candidateCameras, candidateBoards, nullptr);
+        if (candidateSumOfSquares >= sumOfSquares)
+        {
+            lambda *= 10.0;
+            continue;
+        }
+        const double relativeDecrease = (sumOfSquares - candidateSumOfSquares) / sumOfSquares;
+        cameraPoses = std::move(candidateCameras);
+        boardPoses = std::move(candidateBoards);
+        lambda = std::max(lambda / 10.0, 1e-12);
+        if (relativeDecrease < minRelativeDecrease)
+        {
+            sumOfSquares = candidateSumOfSquares;
+            break;
+        }
+        equations = createNormalEquations(countOfCameraBlocks, boardPoses.size());
+        sumOfSquares = reprojectionErrors(observations, _cameraMatrices,
+                                          _cameraDistortionCoefficients, cameraBlocks,
+                                          cameraPoses, boardPoses, &equations);
+    }
+
+    _referenceCamera = referenceCamera;
+    for (size_t camera = 0; camera < countOfCameras; ++camera)
+    {
+        _cameraRotations[camera] = cameraPoses[camera].rotation;
+        _cameraTranslations[camera] = cameraPoses[camera].translation;
+    }
+    return countOfPoints > 0 ? std::sqrt(sumOfSquares / countOfPoints) : -1.0;
+}
+
+size_t timur::MultiCameraCalibration::countOfCameras() const
+{
+    return _cameraMatrices.size();
+}
+
+cv::Mat timur::MultiCameraCalibration::cameraMatrix(const size_t camera) const
+{
+    return _cameraMatrices[camera];
+}
+
+cv::Mat timur::MultiCameraCalibration::distortionCoefficients(const size_t camera) const
+{
+    return _cameraDistortionCoefficients[camera];
+}
+
+cv::Mat timur::MultiCameraCalibration::cameraToReference(const size_t camera) const
+{
+    return cv::Mat(inverseTransform(toTransform(Pose{_cameraRotations[camera],
+                                                     _cameraTranslations[camera]})));
+}
+
+void timur::MultiCameraCalibration::toReference(const size_t camera,
+                                                const cv::Vec3d& rotationVector,
+                                                const cv::Vec3d& translationVector,
+                                                cv::Vec3d& referenceRotationVector,
+                                                cv::Vec3d& referenceTranslationVector) const
+{
+    const Pose objectToReference = toPose(
+        inverseTransform(toTransform(Pose{_cameraRotations[camera], _cameraTranslations[camera]}))
+        * toTransform(Pose{rotationVector, translationVector}));
+    referenceRotationVector = objectToReference.rotation;
+    referenceTranslationVector = objectToReference.translation;
+}
+
+bool timur::MultiCameraCalibration::saveCalibration(const std::string& name) const
+{
+    std::ofstream outStream(name, std::ios::binary);
+    if (!outStream)
+    {
+        return false;
+    }
+
+    MultiCameraFileHeader header{};
+    std::memcpy(header.signature, multiCameraSignature, sizeof(header.signature));
+    header.version = multiCameraVersion;
+    header.countOfCameras = static_cast<std::uint32_t>(_cameraMatrices.size());
+    header.referenceCamera = static_cast<std::uint32_t>(_referenceCamera);
+    outStream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    for (size_t camera = 0; camera < _cameraMatrices.size(); ++camera)
+    {
+        CameraRecord record{};
+        record.width = _imageSizes[camera].width;
+        record.height = _imageSizes[camera].height;
+        cv::Mat cameraMatrix;
+        _cameraMatrices[camera].convertTo(cameraMatrix, CV_64F);
+        std::copy(cameraMatrix.begin<double>(), cameraMatrix.end<double>(), record.cameraMatrix);
+        cv::Mat distortionCoefficients;
+        _cameraDistortionCoefficients[camera].convertTo(distortionCoefficients, CV_64F);
+        record.countOfDistortionCoefficients = static_cast<std::uint32_t>(
+            std::min<size_t>(distortionCoefficients.total(), maxDistortionCoefficients));
+        std::copy_n(distortionCoefficients.begin<double>(), record.countOfDistortionCoefficients,
+                    record.distortionCoefficients);
+        for (int i = 0; i < 3; ++i)
+        {
+            record.rotation[i] = _cameraRotations[camera][i];
+            record.translation[i] = _cameraTranslations[camera][i];
+        }
+        outStream.write(reinterpret_cast<const char*>(&record), sizeof(record));
+    }
+    return static_cast<bool>(outStream);
+}
+
+bool timur::MultiCameraCalibration::loadCalibration(const std::string& name)
+{
+    std::ifstream inStream(name, std::ios::binary);
+    MultiCameraFileHeader header{};
+    if (!inStream.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || std::memcmp(header.signature, multiCameraSignature, sizeof(header.signature)) != 0
+        || header.version != multiCameraVersion || header.referenceCamera >= header.countOfCameras)
+    {
+        return false;
+    }
+
+    std::vector<cv::Mat> cameraMatrices;
+    std::vector<cv::Mat> distortionCoefficients;
+    std::vector<cv::Size> imageSizes;
+    std::vector<cv::Vec3d> rotations;
+    std::vector<cv::Vec3d> translations;
+    for (std::uint32_t camera = 0; camera < header.countOfCameras; ++camera)
+    {
+        CameraRecord record{};
+        if (!inStream.read(reinterpret_cast<char*>(&record), sizeof(record))
+            || record.countOfDistortionCoefficients > maxDistortionCoefficients)
+        {
+            return false;
+        }
+        imageSizes.emplace_back(record.width, record.height);
+        cameraMatrices.push_back(cv::Mat(3, 3, CV_64F, record.cameraMatrix).clone());
+        distortionCoefficients.push_back(
+            cv::Mat(1, static_cast<int>(record.countOfDistortionCoefficients), CV_64F,
+                    record.distortionCoefficients).clone());
+        rotations.emplace_back(record.rotation[0], record.rotation[1], record.rotation[2]);
+        translations.emplace_back(record.translation[0], record.translation[1],
+                                  record.translation[2]);
+    }
+
+    _cameraMatrices = std::move(cameraMatrices);
+    _cameraDistortionCoefficients = std::move(distortionCoefficients);
+    _imageSizes = std::move(imageSizes);
+    _cameraRotations = std::move(rotations);
+    _cameraTranslations = std::move(translations);
+    _referenceCamera = header.referenceCamera;
+    _observations.clear();
+    return true;
+}
@@ -0,0 +1,199 @@
+/**
+ * \file
+ * \brief Header file with class description for extrinsic calibration of several cameras.
+*/
+#ifndef MULTI_CAMERA_CALIBRATION_2017
+#define MULTI_CAMERA_CALIBRATION_2017
+#include "CameraCalibration.h"
+#include <opencv2/videoio.hpp>
+#include <string>
+#include <vector>
+
+namespace timur
+{
+/**
+ * \brief Class for calibration of relative poses of several calibrated cameras with overlapping
+ * views. The board is shown to the cameras simultaneously, all camera poses and board poses are
+ * refined jointly by bundle adjustment with fixed intrinsics.
+ */
+class MultiCameraCalibration : private CameraCalibration
+{
+private:
+    /**
+     * \brief Board points found by one camera on one simultaneous observation.
+     */
+    struct CameraView
+    {
+        bool found;
+        std::vector<cv::Point2f> corners;
+        std::vector<int> ids;
+    };
+
+    /**
+     * \brief Camera matrices of the cameras.
+     */
+    std::vector<cv::Mat> _cameraMatrices;
+
+    /**
+     * \brief Distortion coefficients of the cameras.
+     */
+    std::vector<cv::Mat> _cameraDistortionCoefficients;
+
+    /**
+     * \brief Frame sizes of the cameras (empty until the first observation).
+     */
+    std::vector<cv::Size> _imageSizes;
+
+    /**
+     * \brief Simultaneous observations of the board seen by at least two cameras, every
+     * observation has a view of every camera.
+     */
+    std::vector<std::vector<CameraView>> _observations;
+
+    /**
+     * \brief Camera whose frame is the common frame of all poses.
+     */
+    size_t _referenceCamera;
+
+    /**
+     * \brief Rotation vectors of the transformations from the reference camera frame to every
+     * camera frame.
+     */
+    std::vector<cv::Vec3d> _cameraRotations;
+
+    /**
+     * \brief Translation vectors of the transformations from the reference camera frame to every
+     * camera frame.
+     */
+    std::vector<cv::Vec3d> _cameraTranslations;
+
+public:
+    /**
+     * \brief MultiCameraCalibration constructor.
+     * \param[in] boardDimension Dimension of chessboard or circle grid pattern
+     * (Number of items by width and height, number of squares for charuco board).
+     * \param[in] patternCode Code of using pattern
+     * (chessboard = 0, circlesGrid = 1, asymmetricCirclesGrid = 2, charuco = 3).
+     * \param[in] cameraMatrices Camera matrices of the calibrated cameras.
+     * \param[in] distortionCoefficients Distortion coefficients of the calibrated cameras.
+     * \param[in] squareLength Length of the board square (units of the translations).
+     * \param[in] markerLength Length of the charuco board marker side (less than squareLength).
+     * \param[in] charucoDictionaryId Identifier of the predefined dictionary of charuco markers.
+     */
+    MultiCameraCalibration(const cv::Size boardDimension, const uint patternCode,
+                           const std::vector<cv::Mat>& cameraMatrices,
+                           const std::vector<cv::Mat>& distortionCoefficients,
+                           const float squareLength = 1.0f, const float markerLength = 0.5f,
+                           const int charucoDictionaryId = cv::aruco::DICT_4X4_50);
+
+    /**
+     * \brief MultiCameraCalibration constructor.
+     * \param[in] calibrationFileName Filename with calibration of all cameras, see
+     * saveCalibration.
+     */
+    explicit MultiCameraCalibration(const std::string& calibrationFileName);
+
+    /**
+     * \brief MultiCameraCalibration destructor.
+     */
+    ~MultiCameraCalibration() override = default;
+
+    /**
+     * \brief Grabbing frames of all cameras first and decoding them afterwards, so the frames
+     * are taken as close in time as the cameras allow.
+     * \param[in] cameras Opencv camera objects.
+     * \param[out] frames Frame of every camera.
+     * \return True, if every camera returned a frame, and false, if not.
+     */
+    static bool grabSimultaneously(std::vector<cv::VideoCapture>& cameras,
+                                   std::vector<cv::Mat>& frames);
+
+    /**
+     * \brief Finding the board on simultaneous frames of all cameras (in parallel). The
+     * observation is kept, if at least two cameras found the board.
+     * \param[in] images Greyscale or BGR frame of every camera, empty if the camera has no frame.
+     * \return Count of cameras, which found the board.
+     */
+    int addObservation(const std::vector<cv::Mat>& images);
+
+    /**
+     * \brief Returning count of kept observations.
+     * \return Count of observations seen by at least two cameras.
+     */
+    size_t countOfObservations() const;
+
+    /**
+     * \brief Forgetting the observations, the camera poses are kept.
+     */
+    void resetObservations();
+
+    /**
+     * \brief Calibrating the camera poses on the kept observations. Initial poses are chained
+     * through the observations from the reference camera, then all camera and board poses are
+     * refined by Levenberg-Marquardt. Board poses are eliminated from the normal equations by the
+     * Schur complement, so every iteration solves a system of the camera poses only.
+     * \param[in] referenceCamera Camera whose frame is the common frame.
+     * \param[in] maxIterations Maximum count of Levenberg-Marquardt iterations.
+     * \return RMS reprojection error in pixels, negative if some camera is not connected to the
+     * reference camera by observations.
+     */
+    double calibrate(const size_t referenceCamera = 0, const int maxIterations = 30);
+
+    /**
+     * \brief Returning count of cameras.
+     * \return Count of cameras.
+     */
+    size_t countOfCameras() const;
+
+    /**
+     * \brief Returning camera matrix of the camera.
+     * \param[in] camera Index of the camera.
+     * \return Camera matrix.
+     */
+    cv::Mat cameraMatrix(const size_t camera) const;
+
+    /**
+     * \brief Returning distortion coefficients of the camera.
+     * \param[in] camera Index of the camera.
+     * \return Distortion coefficients.
+     */
+    cv::Mat distortionCoefficients(const size_t camera) const;
+
+    /**
+     * \brief Returning pose of the camera in the reference camera frame, so observations of
+     * every camera can be fused in one frame (e.g. by MarkerMap::addFrame with the pose chained
+     * to the world pose of the reference camera).
+     * \param[in] camera Index of the camera.
+     * \return Transformation 4x4 (CV_64F) from the camera frame to the reference camera frame.
+     */
+    cv::Mat cameraToReference(const size_t camera) const;
+
+    /**
+     * \brief Transforming pose of an object found by the camera to the reference camera frame.
+     * \param[in] camera Index of the camera.
+     * \param[in] rotationVector Object rotation relative to the camera.
+     * \param[in] translationVector Object translation relative to the camera.
+     * \param[out] referenceRotationVector Object rotation relative to the reference camera.
+     * \param[out] referenceTranslationVector Object translation relative to the reference camera.
+     */
+    void toReference(const size_t camera, const cv::Vec3d& rotationVector,
+                     const cv::Vec3d& translationVector, cv::Vec3d& referenceRotationVector,
+                     cv::Vec3d& referenceTranslationVector) const;
+
+    /**
+     * \brief Saving intrinsics and poses of all cameras in versioned binary file.
+     * \param[in] name Name of file to save.
+     * \return True, if the calibration was saved, and false, if not.
+     */
+    bool saveCalibration(const std::string& name) const;
+
+    /**
+     * \brief Download intrinsics and poses of all cameras from binary file.
+     * \param[in] name File name for download.
+     * \return True, if the calibration was loaded, and false, if not.
+     */
+    bool loadCalibration(const std::string& name);
+};
+}
+
+#endif //!MULTI_CAMERA_CALIBRATION_2017
@@ -1,7 +1,9 @@
 #include <iostream>
+#include <string>
 
 #include <opencv2/calib3d/calib3d.hpp>
 #include <ArucoMarkers.h>
+#include <MarkerMap.h>
 #include <CamCalibWI.h>
 #include <fanucModel.h>
 #include <Fanuc.h>
@@ -43,6 +45,12 @@ int startWebcamMonitoring(cv::VideoCapture& vid, const float arucoSqureDimension
 	timur::ArucoMarkers arucoMarkers(arucoSqureDimension, false);
 	std::vector<cv::Vec3d> rotationVectors, translationVectors;
 	std::vector<int> markerIds;
+	std::vector<std::vector<cv::Point2f>> markerCorners;
+
+	// marker poses in the robot frame (mm) learned on previous runs
+	timur::MarkerMap markerMap(arucoSqureDimension * 1000, arucoMarkers.markerDictionary(),
+		cameraMatrix, distanceCoefficients);
+	markerMap.loadMarkerMap("MarkerMap.bin");
 
 	cv::namedWindow("Webcam", CV_WINDOW_AUTOSIZE);
 
@@ -50,8 +58,12 @@ int startWebcamMonitoring(cv::VideoCapture& vid, const float arucoSqureDimension
 	fanuc.startWorking();
 	fanuc.setWorldFrame();
 
+	// the robot reports its joint angles after every move, the camera pose is computed from them
+	fanuc.goToCoordinates(985., 0., 940., 180., 0., 0.);
+	std::array<double, 6> joints = fanuc.getJointAngles();
 	FanucModel robot;
-	const cv::Mat p6 = robot.fanucForwardTask({ 0., 0., 0., 0., -90., 0. });
+	cv::Mat p6 = robot.fanucForwardTask(joints);
+	cv::Mat cameraToWorld = p6 * robot.getToCamera();
 
 	Point startPoint = { p6.at<double>(0,3) , p6.at<double>(1, 3), p6.at<double>(2, 3) };
 	while (true)
@@ -64,11 +76,55 @@ int startWebcamMonitoring(cv::VideoCapture& vid, const float arucoSqureDimension
 		const bool foundMarkers = arucoMarkers.estimateMarkersPose(frame, cameraMatrix,
 			distanceCoefficients,
 			rotationVectors,
-			translationVectors, markerIds);
+			translationVectors, markerIds, markerCorners);
 
+		// the map is trained on every frame from the pose the robot reported last
 		if (foundMarkers)
 		{
-			const cv::Mat res = p6 * robot.getToCamera() * createTransformationMatrix(cv::Vec3d(0, 0, 0), translationVectors[0]) * robot.getToSixth();
+			markerMap.addFrame(cameraToWorld, markerCorners, markerIds);
+		}
+
+		cv::imshow("Webcam", frame);
+		// keys 1..3 switch the detector between fast, balanced and accurate presets,
+		// 'l' checks the map localization, 'm' moves the robot to the first visible marker
+		const int key = cv::waitKey(1);
+		if (key == 27)
+		{
+			break;
+		}
+		if (key >= '1' && key <= '3')
+		{
+			arucoMarkers.setDetectorPreset(key - '1');
+		}
+		if (!foundMarkers)
+		{
+			continue;
+		}
+		if (key == 'l')
+		{
+			// camera position from the visible markers of the map against the robot's one
+			cv::Mat localizedCameraToWorld;
+			if (markerMap.localizeCamera(markerCorners, markerIds, localizedCameraToWorld) > 0)
+			{
+				std::cout << "Map localization error: "
+					<< cv::norm(localizedCameraToWorld(cv::Rect(3, 0, 1, 3)),
+						cameraToWorld(cv::Rect(3, 0, 1, 3))) << " mm" << '\n';
+			}
+		}
+		if (key == 'm')
+		{
+			// the map holds the marker position refined over all frames it was seen on. The robot is
+			// sent to w, p, r = 180, 0, 0 whatever the marker orientation is, so only the marker
+			// position is taken and the target gets the orientation of that tool pose (z down)
+			cv::Mat markerToWorld;
+			if (!markerMap.markerPose(markerIds[0], markerToWorld))
+			{
+				markerToWorld = cameraToWorld * createTransformationMatrix(rotationVectors[0],
+					translationVectors[0]);
+			}
+			cv::Mat target = (cv::Mat_<double>(4, 4) << 1, 0, 0, 0, 0, -1, 0, 0, 0, 0, -1, 0, 0, 0, 0, 1);
+			markerToWorld(cv::Rect(3, 0, 1, 3)).copyTo(target(cv::Rect(3, 0, 1, 3)));
+			const cv::Mat res = target * robot.getToSixth();
 			Point finalPoint = { res.at<double>(0, 3), res.at<double>(1, 3), res.at<double>(2, 3) };
 			TrajectoryMovement trajectory(startPoint,finalPoint, 10);
 			Point curPoint = { 0, 0, 0 };
@@ -82,7 +138,7 @@ int startWebcamMonitoring(cv::VideoCapture& vid, const float arucoSqureDimension
 					                          180,
 					                            0,
 					                            0);
-				fanuc.getJointAngles();
+				joints = fanuc.getJointAngles();
 				cv::imshow("Webcam", frame);
 				if (cv::waitKey(1) == 27)
 				{
@@ -90,17 +146,41 @@ int startWebcamMonitoring(cv::VideoCapture& vid, const float arucoSqureDimension
 				}
 			}
 			system("pause");
-			break;
+			// the map goes on training from the new viewpoint
+			p6 = robot.fanucForwardTask(joints);
+			cameraToWorld = p6 * robot.getToCamera();
+			startPoint = curPoint;
 		}
-		cv::imshow("Webcam", frame);
-		cv::waitKey(1);
 	}
+	markerMap.saveMarkerMap("MarkerMap.bin");
 	cv::destroyWindow("Webcam");
 	return 0;
 }
 
-int main()
+void benchmarkForwardTasks(const size_t countOfPoses)
 {
+	FanucModel robot;
+	double genericSeconds, unrolledSeconds, batchSeconds;
+	const double unrolledDifference = robot.compareForwardTasks(countOfPoses, genericSeconds,
+		unrolledSeconds);
+	const double batchDifference = FanucModel::compareBatchForwardTasks(countOfPoses,
+		unrolledSeconds, batchSeconds);
+	std::cout << "Forward kinematics of " << countOfPoses << " poses, ms: generic "
+		<< genericSeconds * 1000 << ", unrolled " << unrolledSeconds * 1000 << ", batch "
+		<< batchSeconds * 1000 << '\n';
+	std::cout << "Max difference of matrix elements: unrolled " << unrolledDifference << ", batch "
+		<< batchDifference << '\n';
+}
+
+int main(int argc, char* argv[])
+{
+	// "ObjectCoordinates benchmark" only measures the forward kinematics
+	if (argc > 1 && std::string(argv[1]) == "benchmark")
+	{
+		benchmarkForwardTasks(1000000);
+		return 0;
+	}
+
 	///const cv::Size boardDimensions = cv::Size(4, 11);
 	const float arucoSqureDimension = 0.062f;
 
@@ -18,6 +18,8 @@ int startWebcamMonitoring(cv::VideoCapture& vid, const float arucoSqureDimension
                           const cv::Mat cameraMatrix,
                           const cv::Mat distanceCoefficients);
 
-int main();
+void benchmarkForwardTasks(const size_t countOfPoses);
+
+int main(int argc, char* argv[]);
 
 #endif
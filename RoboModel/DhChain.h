@@ -0,0 +1,208 @@
+#ifndef DH_CHAIN
+#define DH_CHAIN
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+#include <opencv2/core/matx.hpp>
+
+/**
+* \brief D-H parameters of one link known at compile time
+*
+* d: offset along previous z in mm;
+* a: offset along x in current frame in mm;
+* alpha: angle about x in current frame in quarter turns (multiple of 90 degrees);
+* integer parameters give exact sin and cos of alpha, so zero terms are removed at compile time
+* (the conditions on them are constant, so the compiler drops the branches)
+*/
+template <int D, int A, int AlphaQuarterTurns>
+struct DhLink
+{
+    static constexpr double d = D;
+    static constexpr double a = A;
+    static constexpr int quarterTurns = (AlphaQuarterTurns % 4 + 4) % 4;
+};
+
+/**
+* \brief chain of D-H links unrolled at compile time: every link is a few multiplications of the
+* rows of the transform matrix by sin and cos of its joint, terms with zero a, d, sin(alpha) or
+* cos(alpha) are not generated
+*/
+template <typename... Links>
+class DhChain
+{
+    /**
+    * \brief function to write a row of the transform matrix multiplied by a link transform
+    * \param[in] x cos(q) * c0 + sin(q) * c1 of the row
+    * \param[in] n cos(q) * c1 - sin(q) * c0 of the row
+    * \param[in] c2 third element of the row before multiplication
+    * \param[in, out] e0, e1, e2, e3 elements of the row
+    */
+    template <typename Link>
+    static void writeRow(const double x, const double n, const double c2, double& e0, double& e1,
+                         double& e2, double& e3)
+    {
+        e0 = x;
+        if (Link::quarterTurns == 0)
+        {
+            e1 = n;
+            e2 = c2;
+        }
+        else if (Link::quarterTurns == 1)
+        {
+            e1 = c2;
+            e2 = -n;
+        }
+        else if (Link::quarterTurns == 2)
+        {
+            e1 = -n;
+            e2 = -c2;
+        }
+        else
+        {
+            e1 = -c2;
+            e2 = n;
+        }
+        if (Link::a != 0)
+        {
+            e3 += Link::a * x;
+        }
+        if (Link::d != 0)
+        {
+            e3 += Link::d * c2;
+        }
+    }
+
+    /**
+    * \brief function to write a row of the transform matrix multiplied by a link transform
+    * \param[in, out] transform transform matrix (4x4)
+    * \param[in] row number of row
+    * \param[in] x cos(q) * c0 + sin(q) * c1 of the row
+    * \param[in] n cos(q) * c1 - sin(q) * c0 of the row
+    * \param[in] c2 third element of the row before multiplication
+    */
+    template <typename Link>
+    static void writeRow(cv::Matx44d& transform, const int row, const double x, const double n,
+                         const double c2)
+    {
+        writeRow<Link>(x, n, c2, transform(row, 0), transform(row, 1), transform(row, 2),
+                       transform(row, 3));
+    }
+
+    /**
+    * \brief function to multiply the transform matrix by the link transform in place
+    * \param[in, out] transform transform matrix (4x4), identity for the first link
+    * \param[in] q generalized D-H coordinate of the link
+    */
+    template <typename Link, bool First>
+    static void appendLink(cv::Matx44d& transform, const double q)
+    {
+        const double sinQ = std::sin(q);
+        const double cosQ = std::cos(q);
+        if (First)
+        {
+            // rows of the identity are known, the link transform is written directly
+            writeRow<Link>(transform, 0, cosQ, -sinQ, 0.0);
+            writeRow<Link>(transform, 1, sinQ, cosQ, 0.0);
+            writeRow<Link>(transform, 2, 0.0, 0.0, 1.0);
+        }
+        else
+        {
+            for (int row = 0; row < 3; ++row)
+            {
+                const double c0 = transform(row, 0);
+                const double c1 = transform(row, 1);
+                const double c2 = transform(row, 2);
+                writeRow<Link>(transform, row, cosQ * c0 + sinQ * c1, cosQ * c1 - sinQ * c0, c2);
+            }
+        }
+    }
+
+    template <std::size_t... Indices>
+    static cv::Matx44d forward(const std::array<double, sizeof...(Links)>& q,
+                               std::index_sequence<Indices...>)
+    {
+        cv::Matx44d transform = cv::Matx44d::eye();
+        // links are appended in order, the array only expands the parameter pack
+        const int order[] = {(appendLink<Links, Indices == 0>(transform, q[Indices]), 0)...};
+        static_cast<void>(order);
+        return transform;
+    }
+
+    /**
+    * \brief function to multiply the transforms of a block of poses by the link transforms
+    * \param[in] count count of poses
+    * \param[in] sinQ sin of the generalized D-H coordinate of the link of every pose
+    * \param[in] cosQ cos of the generalized D-H coordinate of the link of every pose
+    * \param[in, out] transform rows 0..2 of the transform matrices, element by element
+    */
+    template <typename Link, std::size_t BlockSize>
+    static void appendLinkBlock(const std::size_t count, const double* sinQ, const double* cosQ,
+                                double (&transform)[12][BlockSize])
+    {
+        for (int row = 0; row < 3; ++row)
+        {
+            double* e0 = transform[4 * row];
+            double* e1 = transform[4 * row + 1];
+            double* e2 = transform[4 * row + 2];
+            double* e3 = transform[4 * row + 3];
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                const double c0 = e0[i];
+                const double c1 = e1[i];
+                const double c2 = e2[i];
+                writeRow<Link>(cosQ[i] * c0 + sinQ[i] * c1, cosQ[i] * c1 - sinQ[i] * c0, c2, e0[i],
+                               e1[i], e2[i], e3[i]);
+            }
+        }
+    }
+
+    template <std::size_t BlockSize, std::size_t... Indices>
+    static void forwardBlock(const std::size_t count,
+                             const double (&sinQ)[sizeof...(Links)][BlockSize],
+                             const double (&cosQ)[sizeof...(Links)][BlockSize],
+                             double (&transform)[12][BlockSize], std::index_sequence<Indices...>)
+    {
+        for (int element = 0; element < 12; ++element)
+        {
+            const double value = element % 5 == 0 ? 1.0 : 0.0;
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                transform[element][i] = value;
+            }
+        }
+        const int order[] = {
+            (appendLinkBlock<Links>(count, sinQ[Indices], cosQ[Indices], transform), 0)...};
+        static_cast<void>(order);
+    }
+
+public:
+    /**
+    * \brief function for solving forward kinematic task of the chain
+    * \param[in] q generalized D-H coordinates of every link
+    * \return transform matrix (4x4) from end-effector frame to world frame
+    */
+    static cv::Matx44d forward(const std::array<double, sizeof...(Links)>& q)
+    {
+        return forward(q, std::index_sequence_for<Links...>());
+    }
+
+    /**
+    * \brief function for solving forward kinematic task of the chain for a block of poses in
+    * structure of arrays layout, every loop runs over the poses, so the compiler can vectorize it
+    * \param[in] count count of poses, not more than BlockSize
+    * \param[in] sinQ sin of the generalized D-H coordinates: [link][pose]
+    * \param[in] cosQ cos of the generalized D-H coordinates: [link][pose]
+    * \param[out] transform rows 0..2 of the transform matrices: [row * 4 + column][pose]
+    */
+    template <std::size_t BlockSize>
+    static void forwardBlock(const std::size_t count,
+                             const double (&sinQ)[sizeof...(Links)][BlockSize],
+                             const double (&cosQ)[sizeof...(Links)][BlockSize],
+                             double (&transform)[12][BlockSize])
+    {
+        forwardBlock(count, sinQ, cosQ, transform, std::index_sequence_for<Links...>());
+    }
+};
+
+#endif
@@ -1,8 +1,24 @@
 #include "fanucModel.h"
 #include <opencv2/core.hpp>
+#include <opencv2/core/utility.hpp>
+#include <algorithm>
+#include <cmath>
 #include <vector>
 #define PI 3.14159265
 
+namespace
+{
+/**
+* \brief count of poses processed together by the batch forward kinematic task
+*/
+const size_t batchBlockSize = 64;
+
+/**
+* \brief minimum count of poses to process the batch in parallel
+*/
+const size_t minParallelBatch = 4096;
+}
+
 FanucModel::FanucModel()
     : RoboModel(std::vector<std::array<double, 4>>{
           {0, 0, 150, PI / 2},
@@ -22,28 +38,212 @@ FanucModel::FanucModel()
 {
 }
 
-std::vector<double> FanucModel::jointsToQ(std::array<double, 6> j)
+std::array<double, 6> FanucModel::jointsToQ(const std::array<double, 6>& j)
 {
     //degrees to radians
-    for (int i = 0; i < 6; ++i)
+    const double toRadians = PI / 180.0;
+    std::array<double, 6> q;
+    q[0] = j[0] * toRadians;
+    q[1] = -j[1] * toRadians + PI / 2;
+    q[2] = j[2] * toRadians + j[1] * toRadians;
+    q[3] = -j[3] * toRadians;
+    q[4] = j[4] * toRadians;
+    q[5] = -j[5] * toRadians;
+    return q;
+}
+
+cv::Mat FanucModel::fanucForwardTask(const std::array<double, 6>& inputjoints) const
+{
+    return cv::Mat(fanucForwardTransform(inputjoints));
+}
+
+cv::Matx44d FanucModel::fanucForwardTransform(const std::array<double, 6>& inputjoints) const
+{
+    const std::array<double, 6> q = jointsToQ(inputjoints);
+    return forwardTransform(q.data(), q.size());
+}
+
+cv::Matx44d FanucModel::fanucForwardTransformUnrolled(const std::array<double, 6>& inputjoints)
+{
+    return FanucChain::forward(jointsToQ(inputjoints));
+}
+
+double FanucModel::compareForwardTasks(const size_t countOfPoses, double& genericSeconds,
+                                       double& unrolledSeconds) const
+{
+    cv::RNG rng;
+    std::vector<std::array<double, 6>> poses(countOfPoses);
+    for (auto& joints : poses)
     {
-        j[i] *= PI / 180.0;
+        for (auto& joint : joints)
+        {
+            joint = rng.uniform(-180.0, 180.0);
+        }
+    }
+
+    // alpha of the generic chain is a multiple of the rounded PI, so the difference is not zero
+    double maxDifference = 0.0;
+    for (const auto& joints : poses)
+    {
+        const cv::Matx44d difference = fanucForwardTransform(joints)
+                                       - fanucForwardTransformUnrolled(joints);
+        for (int i = 0; i < 3; ++i)
+        {
+            for (int j = 0; j < 4; ++j)
+            {
+                maxDifference = std::max(maxDifference, std::abs(difference(i, j)));
+            }
+        }
+    }
+
+    // the sum keeps the loops from being optimized away
+    double checksum = 0.0;
+    int64 start = cv::getTickCount();
+    for (const auto& joints : poses)
+    {
+        checksum += fanucForwardTransform(joints)(0, 3);
+    }
+    genericSeconds = (cv::getTickCount() - start) / cv::getTickFrequency();
+
+    start = cv::getTickCount();
+    for (const auto& joints : poses)
+    {
+        checksum += fanucForwardTransformUnrolled(joints)(0, 3);
+    }
+    unrolledSeconds = (cv::getTickCount() - start) / cv::getTickFrequency();
+
+    volatile double sink = checksum;
+    static_cast<void>(sink);
+    return maxDifference;
+}
+
+void FanucModel::fanucForwardTransformBatch(const size_t countOfPoses,
+                                            const std::array<const double*, 6>& joints,
+                                            const std::array<double*, 3>& positions,
+                                            const std::array<double*, 9>& rotations)
+{
+    const size_t countOfBlocks = (countOfPoses + batchBlockSize - 1) / batchBlockSize;
+    const auto processBlocks = [&](const cv::Range& range)
+    {
+        double q[6][batchBlockSize];
+        double sinQ[6][batchBlockSize];
+        double cosQ[6][batchBlockSize];
+        double transform[12][batchBlockSize];
+        for (int block = range.start; block < range.end; ++block)
+        {
+            const size_t first = block * batchBlockSize;
+            const size_t count = std::min(batchBlockSize, countOfPoses - first);
+
+            // degrees to D-H generalized angles as in jointsToQ
+            const double toRadians = PI / 180.0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                q[0][i] = joints[0][first + i] * toRadians;
+                q[1][i] = -joints[1][first + i] * toRadians + PI / 2;
+                q[2][i] = joints[2][first + i] * toRadians + joints[1][first + i] * toRadians;
+                q[3][i] = -joints[3][first + i] * toRadians;
+                q[4][i] = joints[4][first + i] * toRadians;
+                q[5][i] = -joints[5][first + i] * toRadians;
+            }
+            // separate loops: sin and cos in one loop are fused into a scalar sincos call, alone
+            // each of them can be replaced by a vector math library version
+            for (int link = 0; link < 6; ++link)
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    sinQ[link][i] = std::sin(q[link][i]);
+                }
+                for (size_t i = 0; i < count; ++i)
+                {
+                    cosQ[link][i] = std::cos(q[link][i]);
+                }
+            }
+
+            FanucChain::forwardBlock(count, sinQ, cosQ, transform);
+
+            for (int row = 0; row < 3; ++row)
+            {
+                std::copy_n(transform[4 * row + 3], count, positions[row] + first);
+                for (int column = 0; column < 3; ++column)
+                {
+                    std::copy_n(transform[4 * row + column], count,
+                                rotations[3 * row + column] + first);
+                }
+            }
+        }
+    };
+
+    const cv::Range blocks(0, static_cast<int>(countOfBlocks));
+    if (countOfPoses >= minParallelBatch)
+    {
+        cv::parallel_for_(blocks, processBlocks);
+    }
+    else
+    {
+        processBlocks(blocks);
     }
-    std::vector<double> q;
-    q.resize(6);
-    q[0] = j[0];
-    q[1] = -j[1] + PI / 2;
-    q[2] = j[2] + j[1];
-    q[3] = -j[3];
-    q[4] = j[4];
-    q[5] = -j[5];
-    return q;
 }
 
-cv::Mat FanucModel::fanucForwardTask(const std::array<double, 6> inputjoints)
+double FanucModel::compareBatchForwardTasks(const size_t countOfPoses, double& unrolledSeconds,
+                                            double& batchSeconds)
 {
-    const std::vector<double> q = jointsToQ(inputjoints);
-    return forwardTask(q);
+    cv::RNG rng;
+    std::vector<std::array<double, 6>> poses(countOfPoses);
+    std::vector<std::vector<double>> jointsOfPoses(6, std::vector<double>(countOfPoses));
+    for (size_t i = 0; i < countOfPoses; ++i)
+    {
+        for (int joint = 0; joint < 6; ++joint)
+        {
+            poses[i][joint] = rng.uniform(-180.0, 180.0);
+            jointsOfPoses[joint][i] = poses[i][joint];
+        }
+    }
+
+    // both versions store every result, so neither loop is optimized away
+    std::vector<cv::Matx44d> transforms(countOfPoses);
+    int64 start = cv::getTickCount();
+    for (size_t i = 0; i < countOfPoses; ++i)
+    {
+        transforms[i] = fanucForwardTransformUnrolled(poses[i]);
+    }
+    unrolledSeconds = (cv::getTickCount() - start) / cv::getTickFrequency();
+
+    std::vector<std::vector<double>> elements(12, std::vector<double>(countOfPoses));
+    std::array<const double*, 6> joints;
+    std::array<double*, 3> positions;
+    std::array<double*, 9> rotations;
+    for (int joint = 0; joint < 6; ++joint)
+    {
+        joints[joint] = jointsOfPoses[joint].data();
+    }
+    for (int row = 0; row < 3; ++row)
+    {
+        positions[row] = elements[9 + row].data();
+        for (int column = 0; column < 3; ++column)
+        {
+            rotations[3 * row + column] = elements[3 * row + column].data();
+        }
+    }
+    start = cv::getTickCount();
+    fanucForwardTransformBatch(countOfPoses, joints, positions, rotations);
+    batchSeconds = (cv::getTickCount() - start) / cv::getTickFrequency();
+
+    double maxDifference = 0.0;
+    for (size_t i = 0; i < countOfPoses; ++i)
+    {
+        for (int row = 0; row < 3; ++row)
+        {
+            maxDifference = std::max(maxDifference,
+                                     std::abs(positions[row][i] - transforms[i](row, 3)));
+            for (int column = 0; column < 3; ++column)
+            {
+                maxDifference = std::max(maxDifference,
+                                         std::abs(rotations[3 * row + column][i]
+                                                  - transforms[i](row, column)));
+            }
+        }
+    }
+    return maxDifference;
 }
 
 std::array<double, 3> FanucModel::anglesFromMat(const cv::Mat p6)
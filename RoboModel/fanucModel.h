@@ -1,6 +1,7 @@
 #ifndef FANUC_MODEL
 #define FANUC_MODEL
 #include "newRM.h"
+#include "DhChain.h"
 #define PI 3.14159265
 
 /**
@@ -13,7 +14,7 @@ class FanucModel : RoboModel
     * \param[in] j joints angles
     * \return Denavit-Hartenberg generalized angles
     */
-    static std::vector<double> jointsToQ(std::array<double, 6> j);
+    static std::array<double, 6> jointsToQ(const std::array<double, 6>& j);
 
     /**
     * \brief function to calculate three rotation angles from transformation matrix
@@ -22,6 +23,13 @@ class FanucModel : RoboModel
     */
     static std::array<double, 3> anglesFromMat(const cv::Mat p6);
 
+    /**
+    * \brief D-H chain of Fanuc M20ia unrolled at compile time, the same links as in the constructor
+    * (d, a in mm, alpha in quarter turns)
+    */
+    using FanucChain = DhChain<DhLink<0, 150, 1>, DhLink<0, 790, 0>, DhLink<0, 250, 1>,
+                               DhLink<835, 0, -1>, DhLink<0, 0, 1>, DhLink<100, 0, 0>>;
+
     const cv::Mat _toCamera, _toSixth, _forMovingToCamera;
 public:
     /**
@@ -34,7 +42,59 @@ public:
     * \param[in] inputjoints joints angles
     * \return coordinates of end-effector in world frame: x, y, z in mm and w, p, r in radians
     */
-    cv::Mat fanucForwardTask(std::array<double, 6> inputjoints);
+    cv::Mat fanucForwardTask(const std::array<double, 6>& inputjoints) const;
+
+    /**
+    * \brief function for solving forward kinematic task for Fanuc M20ia without heap allocations
+    * \param[in] inputjoints joints angles
+    * \return transform matrix (4x4) from end-effector frame to world frame
+    */
+    cv::Matx44d fanucForwardTransform(const std::array<double, 6>& inputjoints) const;
+
+    /**
+    * \brief function for solving forward kinematic task for Fanuc M20ia in closed form generated
+    * from the compile-time D-H chain
+    * \param[in] inputjoints joints angles
+    * \return transform matrix (4x4) from end-effector frame to world frame
+    */
+    static cv::Matx44d fanucForwardTransformUnrolled(const std::array<double, 6>& inputjoints);
+
+    /**
+    * \brief function to check the unrolled forward kinematic task against the generic one and to
+    * measure both on the same random joints angles
+    * \param[in] countOfPoses count of random joints angles
+    * \param[out] genericSeconds time of the generic forward kinematic task for all poses
+    * \param[out] unrolledSeconds time of the unrolled forward kinematic task for all poses
+    * \return maximum absolute difference of the transform matrices elements
+    */
+    double compareForwardTasks(const size_t countOfPoses, double& genericSeconds,
+                               double& unrolledSeconds) const;
+
+    /**
+    * \brief function for solving forward kinematic task for Fanuc M20ia on many poses in structure
+    * of arrays layout, poses are processed by blocks in loops over the poses and large batches in
+    * parallel
+    * \param[in] countOfPoses count of poses
+    * \param[in] joints arrays of every joint angle of all poses
+    * \param[out] positions preallocated arrays of x, y, z in mm of end-effector of all poses
+    * \param[out] rotations preallocated arrays of every element of the rotation matrix (row by
+    * row) of end-effector of all poses
+    */
+    static void fanucForwardTransformBatch(const size_t countOfPoses,
+                                           const std::array<const double*, 6>& joints,
+                                           const std::array<double*, 3>& positions,
+                                           const std::array<double*, 9>& rotations);
+
+    /**
+    * \brief function to check the batch forward kinematic task against the unrolled one and to
+    * measure both on the same random joints angles
+    * \param[in] countOfPoses count of random joints angles
+    * \param[out] unrolledSeconds time of the unrolled forward kinematic task for all poses
+    * \param[out] batchSeconds time of the batch forward kinematic task for all poses
+    * \return maximum absolute difference of the transform matrices elements
+    */
+    static double compareBatchForwardTasks(const size_t countOfPoses, double& unrolledSeconds,
+                                           double& batchSeconds);
 
     cv::Mat getToCamera() const;
 
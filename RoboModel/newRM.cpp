@@ -8,12 +8,16 @@ struct RoboModel::DhParameters
     double _qParam;
     double _aParam;
     double _alphaParam;
+    double _sinAlpha;
+    double _cosAlpha;
 
     DhParameters(const double d, const double q, const double a, const double alpha)
         : _dParam(d),
           _qParam(q),
           _aParam(a),
-          _alphaParam(alpha)
+          _alphaParam(alpha),
+          _sinAlpha(sin(alpha)),
+          _cosAlpha(cos(alpha))
     {
     }
 };
@@ -30,41 +34,49 @@ RoboModel::~RoboModel()
 {
 }
 
-cv::Mat RoboModel::forwardTask(std::vector<double> inputq)
+void RoboModel::appendLink(cv::Matx44d& transform, const DhParameters& link, const double q)
 {
-    _kinematicChain[0]._qParam = inputq[0];
-    cv::Mat transformMatrix = prevMatTransform(0);
-    for (int i = 1; i < inputq.size(); ++i)
+    const double sinQ = sin(q);
+    const double cosQ = cos(q);
+    // columns of the product from the columns c0..c3 of the transform:
+    // x = cosQ * c0 + sinQ * c1, y = cosAlpha * n + sinAlpha * c2, z = cosAlpha * c2 - sinAlpha * n,
+    // where n = cosQ * c1 - sinQ * c0, and p = a * x + d * c2 + c3
+    for (int row = 0; row < 3; ++row)
     {
-        _kinematicChain[i]._qParam = inputq[i];
-        transformMatrix = transformMatrix * prevMatTransform(i);
+        const double c0 = transform(row, 0);
+        const double c1 = transform(row, 1);
+        const double c2 = transform(row, 2);
+        const double x = cosQ * c0 + sinQ * c1;
+        const double n = cosQ * c1 - sinQ * c0;
+        transform(row, 0) = x;
+        transform(row, 1) = link._cosAlpha * n + link._sinAlpha * c2;
+        transform(row, 2) = link._cosAlpha * c2 - link._sinAlpha * n;
+        transform(row, 3) += link._aParam * x + link._dParam * c2;
     }
+}
 
+cv::Matx44d RoboModel::forwardTransform(const double* inputq, const size_t countOfJoints) const
+{
+    cv::Matx44d transformMatrix = cv::Matx44d::eye();
+    for (size_t i = 0; i < countOfJoints; ++i)
+    {
+        appendLink(transformMatrix, _kinematicChain[i], inputq[i]);
+    }
     return transformMatrix;
 }
 
-cv::Mat RoboModel::prevMatTransform(const int i)
+cv::Mat RoboModel::forwardTask(const std::vector<double>& inputq) const
 {
-    cv::Mat result(4, 4, CV_64F);
-    result.at<double>(0, 0) = cos(_kinematicChain[i]._qParam);
-    result.at<double>(0, 1) = -cos(_kinematicChain[i]._alphaParam) *
-                              sin(_kinematicChain[i]._qParam);
-    result.at<double>(0, 2) = sin(_kinematicChain[i]._alphaParam) * sin(_kinematicChain[i]._qParam);
-    result.at<double>(0, 3) = _kinematicChain[i]._aParam * cos(_kinematicChain[i]._qParam);
-
-    result.at<double>(1, 0) = sin(_kinematicChain[i]._qParam);
-    result.at<double>(1, 1) = cos(_kinematicChain[i]._alphaParam) * cos(_kinematicChain[i]._qParam);
-    result.at<double>(1, 2) = -sin(_kinematicChain[i]._alphaParam) *
-                              cos(_kinematicChain[i]._qParam);
-    result.at<double>(1, 3) = _kinematicChain[i]._aParam * sin(_kinematicChain[i]._qParam);
-
-    result.at<double>(2, 0) = 0;
-    result.at<double>(2, 1) = sin(_kinematicChain[i]._alphaParam);
-    result.at<double>(2, 2) = cos(_kinematicChain[i]._alphaParam);
-    result.at<double>(2, 3) = _kinematicChain[i]._dParam;
-
-    result.at<double>(3, 0) = result.at<double>(3, 1) = result.at<double>(3, 2) = 0;
-    result.at<double>(3, 3) = 1;
+    return cv::Mat(forwardTransform(inputq.data(), inputq.size()));
+}
 
-    return result;
+cv::Matx44d RoboModel::prevMatTransform(const int i, const double q) const
+{
+    const DhParameters& link = _kinematicChain[i];
+    const double sinQ = sin(q);
+    const double cosQ = cos(q);
+    return cv::Matx44d(cosQ, -link._cosAlpha * sinQ, link._sinAlpha * sinQ, link._aParam * cosQ,
+                       sinQ, link._cosAlpha * cosQ, -link._sinAlpha * cosQ, link._aParam * sinQ,
+                       0, link._sinAlpha, link._cosAlpha, link._dParam,
+                       0, 0, 0, 1);
 }
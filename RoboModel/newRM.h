@@ -2,6 +2,7 @@
 #define NEW_RM
 #include <vector>
 #include <opencv2/core/mat.hpp>
+#include <opencv2/core/matx.hpp>
 #include <array>
 
 /**
@@ -18,6 +19,7 @@ private:
     * q: angle about previous  z, from old  x to new  x;
     * a: offset along x in current frame;
     * alpha: angle about x in current frame;
+    * sin and cos of alpha are cached, they are constant for the chain.
     */
     struct DhParameters;
 
@@ -26,13 +28,23 @@ private:
     */
     std::vector<DhParameters> _kinematicChain;
 
+    /**
+    * \brief function to multiply a transform matrix by the transform from i-th frame to (i-1)-th
+    * in place, using that the last row of both is (0, 0, 0, 1)
+    * \param[in, out] transform transform matrix (4x4) to (i-1)-th frame
+    * \param[in] link D-H parameters of i-th frame
+    * \param[in] q generalized D-H coordinate of i-th frame
+    */
+    static void appendLink(cv::Matx44d& transform, const DhParameters& link, const double q);
+
 protected:
     /**
     * \brief function to calculate a transform matrix from i-th frame to (i-1)-th
     * \param[in] i number of frame
+    * \param[in] q generalized D-H coordinate of i-th frame
     * \return transform matrix (4x4)
     */
-    cv::Mat prevMatTransform(const int i);
+    cv::Matx44d prevMatTransform(const int i, const double q) const;
 
     /**
     * \brief constructor with parameters for any robot
@@ -42,12 +54,20 @@ protected:
 
     ~RoboModel();
 
+    /**
+    * \brief function for solving forward kinematic task without heap allocations
+    * \param[in] inputq generalized D-H coordinates of the first countOfJoints frames
+    * \param[in] countOfJoints count of the coordinates
+    * \return transform matrix (4x4) from end-effector frame to world frame
+    */
+    cv::Matx44d forwardTransform(const double* inputq, const size_t countOfJoints) const;
+
     /**
     * \brief function for solving forward kinematic task
     * \param[in] inputq generalized D-H coordinates
     * \return coordinates of end-effector in world frame: x, y, z in mm and w, p, r in radians
     */
-    cv::Mat forwardTask(std::vector<double> inputq);
+    cv::Mat forwardTask(const std::vector<double>& inputq) const;
 };
 
 #endif